@@ -0,0 +1,378 @@
+#ifndef KATANAOPS_ARENA_H
+#define KATANAOPS_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+
+/**
+ * Whether the attributes can be constructed from data they take ownership
+ * of, through the constructors taking a context and a free callback. Defaults
+ * to on, define it to 0 for Katana versions without those constructors, in
+ * which case the data is copied.
+ */
+#ifndef KATANAOPS_ZERO_COPY_ATTRIBUTES
+#define KATANAOPS_ZERO_COPY_ATTRIBUTES 1
+#endif
+
+namespace KatanaOps
+{
+
+/**
+ * KATANAOPS_ZERO_COPY_ATTRIBUTES as a constant, for the templates building
+ * attributes to only instantiate the constructors in use
+ */
+constexpr bool kZeroCopyAttributes = KATANAOPS_ZERO_COPY_ATTRIBUTES != 0;
+
+/**
+ * BufferPool
+ *
+ * Process-wide pool of buffers of power of two size classes, from 256 bytes
+ * to 1 GiB, larger buffers going straight to the system allocator.
+ *
+ * Buffers handed to attributes are released whenever the attribute is
+ * destroyed, possibly by another thread, and long after the cook that
+ * allocated them. Recycling them avoids going back to the system allocator,
+ * whose large allocations are mapped and unmapped each time, under a process
+ * wide lock, when many cook threads produce big arrays. Each size class has
+ * its own lock, held only to push or pop a buffer. The released buffers
+ * retained by all the classes together are capped to getMaxRetainedBytes(),
+ * kDefaultMaxRetainedBytes unless set in megabytes by the
+ * KATANAOPS_POOL_MEGABYTES environment variable, 0 disabling the recycling.
+ * Buffers of classes larger than the cap always go back to the system.
+ */
+class BufferPool
+{
+public:
+
+    enum
+    {
+        kMinClassBits = 8,
+        kMaxClassBits = 30,
+        kNumClasses = kMaxClassBits - kMinClassBits + 1
+    };
+
+    static const size_t kDefaultMaxRetainedBytes = size_t(256) << 20;
+
+    /**
+     * Returns the pool, which is never destroyed, as attributes holding its
+     * buffers can outlive the static objects of the plug-in
+     */
+    static BufferPool& get()
+    {
+        static BufferPool *s_pool = new BufferPool;
+        return *s_pool;
+    }
+
+    /**
+     * Returns the number of bytes of released buffers that the pool retains
+     * at most, all size classes included
+     */
+    static size_t getMaxRetainedBytes()
+    {
+        static const size_t s_maxRetainedBytes = []()
+        {
+            if (const char *value = std::getenv("KATANAOPS_POOL_MEGABYTES"))
+            {
+                char *end = nullptr;
+                const unsigned long long megabytes =
+                    std::strtoull(value, &end, 10);
+                if (end != value)
+                {
+                    return static_cast<size_t>(megabytes) << 20;
+                }
+            }
+            return kDefaultMaxRetainedBytes;
+        }();
+        return s_maxRetainedBytes;
+    }
+
+    /**
+     * Returns a buffer of at least the given number of bytes, suitably
+     * aligned for any scalar type, to be released with release()
+     */
+    void* allocate(size_t bytes)
+    {
+        const int sizeClass = getSizeClass(bytes);
+        if (sizeClass < kNumClasses)
+        {
+            FreeList &freeList = m_freeLists[sizeClass];
+            std::lock_guard<std::mutex> lock(freeList.mutex);
+            if (!freeList.blocks.empty())
+            {
+                Header *header = freeList.blocks.back();
+                freeList.blocks.pop_back();
+                m_retainedBytes.fetch_sub(getClassBytes(sizeClass),
+                                          std::memory_order_relaxed);
+                return header + 1;
+            }
+        }
+
+        const size_t blockBytes = sizeClass < kNumClasses ?
+            getClassBytes(sizeClass) : bytes;
+        Header *header = static_cast<Header*>(
+            std::malloc(sizeof(Header) + blockBytes));
+        if (!header)
+        {
+            throw std::bad_alloc();
+        }
+        header->sizeClass = sizeClass;
+        return header + 1;
+    }
+
+    /**
+     * Returns a buffer obtained from allocate() to the pool
+     */
+    void release(void *data)
+    {
+        Header *header = static_cast<Header*>(data) - 1;
+        const int sizeClass = header->sizeClass;
+        if (sizeClass < kNumClasses && reserve(getClassBytes(sizeClass)))
+        {
+            FreeList &freeList = m_freeLists[sizeClass];
+            std::lock_guard<std::mutex> lock(freeList.mutex);
+            freeList.blocks.push_back(header);
+            return;
+        }
+        std::free(header);
+    }
+
+    /**
+     * Releases the buffer given as context, with the signature of the free
+     * callbacks of the attribute constructors
+     */
+    static void releaseCallback(void *context)
+    {
+        get().release(context);
+    }
+
+private:
+
+    union Header
+    {
+        int sizeClass;
+        std::max_align_t alignment;
+    };
+
+    struct FreeList
+    {
+        std::mutex mutex;
+        std::vector<Header*> blocks;
+    };
+
+    BufferPool() : m_retainedBytes(0)
+    {
+        const size_t maxRetainedBytes = getMaxRetainedBytes();
+        for (int i = 0; i < kNumClasses; ++i)
+        {
+            m_freeLists[i].blocks.reserve(
+                std::min<size_t>(maxRetainedBytes / getClassBytes(i), 64));
+        }
+    }
+
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    /**
+     * Returns the index of the smallest size class holding the given number
+     * of bytes, or kNumClasses if there is none
+     */
+    static int getSizeClass(size_t bytes)
+    {
+        int sizeClass = 0;
+        while (sizeClass < kNumClasses && getClassBytes(sizeClass) < bytes)
+        {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+    static size_t getClassBytes(int sizeClass)
+    {
+        return size_t(1) << (sizeClass + kMinClassBits);
+    }
+
+    /**
+     * Accounts for a released buffer of the given number of bytes being
+     * retained, returning false, without accounting for it, if it would
+     * exceed the cap
+     */
+    bool reserve(size_t bytes)
+    {
+        const size_t maxRetainedBytes = getMaxRetainedBytes();
+        size_t retainedBytes = m_retainedBytes.load(std::memory_order_relaxed);
+        do
+        {
+            if (bytes > maxRetainedBytes ||
+                retainedBytes > maxRetainedBytes - bytes)
+            {
+                return false;
+            }
+        }
+        while (!m_retainedBytes.compare_exchange_weak(
+                   retainedBytes, retainedBytes + bytes,
+                   std::memory_order_relaxed));
+        return true;
+    }
+
+    FreeList m_freeLists[kNumClasses];
+
+    // Bytes of the buffers held by all the free lists
+    std::atomic<size_t> m_retainedBytes;
+};
+
+/**
+ * CookArena
+ *
+ * Allocates the arrays produced by a cook from the BufferPool, so that they
+ * can be built in place and handed over to attributes without being copied,
+ * see makeAttribute(). Arrays that haven't been handed over are released
+ * when the arena goes out of scope.
+ *
+ * An arena is meant to be used by a single thread, for the duration of a
+ * cook.
+ */
+class CookArena
+{
+public:
+
+    CookArena() {}
+
+    ~CookArena()
+    {
+        BufferPool &pool = BufferPool::get();
+        for (size_t i = 0; i < m_buffers.size(); ++i)
+        {
+            if (m_buffers[i])
+            {
+                pool.release(m_buffers[i]);
+            }
+        }
+    }
+
+    /**
+     * Returns an uninitialized array of the given number of values
+     */
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        m_buffers.reserve(m_buffers.size() + 1);
+        void *buffer = BufferPool::get().allocate(
+            std::max<size_t>(count, 1) * sizeof(T));
+        m_buffers.push_back(buffer);
+        return static_cast<T*>(buffer);
+    }
+
+    /**
+     * Returns an attribute holding the given values, which must have been
+     * returned by allocate() and are handed over to the attribute, the
+     * arena no longer owning them
+     */
+    template <typename AttributeType>
+    AttributeType makeAttribute(
+        const typename AttributeType::value_type *values, int64_t count,
+        int64_t tupleSize)
+    {
+        if constexpr (kZeroCopyAttributes)
+        {
+            void *buffer =
+                const_cast<typename AttributeType::value_type*>(values);
+            if (handOver(buffer))
+            {
+                return AttributeType(values, count, tupleSize, buffer,
+                                     &BufferPool::releaseCallback);
+            }
+        }
+        return AttributeType(values, count, tupleSize);
+    }
+
+    /**
+     * Returns an attribute holding the given time samples, of 'count' values
+     * each, stored one after the other in 'values', which must have been
+     * returned by allocate() and are handed over to the attribute
+     */
+    template <typename AttributeType>
+    AttributeType makeAttribute(
+        const float *times, int64_t numberOfSamples,
+        const typename AttributeType::value_type *values, int64_t count,
+        int64_t tupleSize)
+    {
+        typedef typename AttributeType::value_type ValueType;
+        std::vector<const ValueType*> samples(
+            static_cast<size_t>(numberOfSamples));
+        for (int64_t i = 0; i < numberOfSamples; ++i)
+        {
+            samples[static_cast<size_t>(i)] = values + i * count;
+        }
+
+        if constexpr (kZeroCopyAttributes)
+        {
+            void *buffer = const_cast<ValueType*>(values);
+            if (handOver(buffer))
+            {
+                return AttributeType(times, numberOfSamples, samples.data(),
+                                     count, tupleSize, buffer,
+                                     &BufferPool::releaseCallback);
+            }
+        }
+        return AttributeType(times, numberOfSamples, samples.data(), count,
+                             tupleSize);
+    }
+
+private:
+
+    /**
+     * Stops owning the given buffer, returns false if it isn't one of the
+     * arena's
+     */
+    bool handOver(void *buffer)
+    {
+        std::vector<void*>::iterator it =
+            std::find(m_buffers.begin(), m_buffers.end(), buffer);
+        if (it == m_buffers.end())
+        {
+            return false;
+        }
+        *it = nullptr;
+        return true;
+    }
+
+    CookArena(const CookArena&);
+    CookArena& operator=(const CookArena&);
+
+    std::vector<void*> m_buffers;
+};
+
+/**
+ * Returns an attribute referencing the given values, which must live as long
+ * as the plug-in, such as constant tables, without copying them
+ */
+template <typename AttributeType>
+AttributeType wrapStaticData(const typename AttributeType::value_type *values,
+                             int64_t count, int64_t tupleSize)
+{
+    struct Callback
+    {
+        static void doNothing(void*) {}
+    };
+    if constexpr (kZeroCopyAttributes)
+    {
+        return AttributeType(values, count, tupleSize, nullptr,
+                             &Callback::doNothing);
+    }
+    else
+    {
+        return AttributeType(values, count, tupleSize);
+    }
+}
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_ARENA_H
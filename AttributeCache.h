@@ -0,0 +1,530 @@
+#ifndef KATANAOPS_ATTRIBUTECACHE_H
+#define KATANAOPS_ATTRIBUTECACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+
+#include "Arena.h"
+#include "MappedFile.h"
+
+namespace KatanaOps
+{
+
+/**
+ * AttributeCache
+ *
+ * Persistent cache of attributes on disk, shared by all the processes
+ * pointed at the same directory, farm tasks cooking the same scenes for
+ * example, so that the attributes heavy to build are built once.
+ *
+ * Attributes are stored under a key attribute, the Op arguments they are built
+ * from, one file per key named after its hash. Files are written whole to a
+ * temporary file of their own first, created exclusively, see
+ * createTemporaryFile(), then renamed, so that concurrent writers, on any
+ * host, and readers only ever see complete files. Loading memory maps the
+ * file: the numeric arrays of the attributes returned reference the mapped
+ * pages, which are only read from disk when accessed, and stay mapped as long
+ * as any of them is held (when KATANAOPS_ZERO_COPY_ATTRIBUTES is off they are
+ * copied). Files that can't be read, or were written by another version of the
+ * format, are treated as missing, and replaced by the next store().
+ *
+ * The cache never evicts anything: clear the directory when the data it
+ * holds is no longer needed.
+ */
+class AttributeCache
+{
+public:
+
+    explicit AttributeCache(const std::string &directory)
+        : m_directory(directory)
+    {
+    }
+
+    /**
+     * Returns the cache of the directory given by the KATANAOPS_CACHE_DIR
+     * environment variable, or null if it isn't set
+     */
+    static AttributeCache* getDefault()
+    {
+        static AttributeCache *s_cache = createDefault();
+        return s_cache;
+    }
+
+    const std::string& getDirectory() const { return m_directory; }
+
+    /**
+     * Returns the path of the file the attributes of the given key are
+     * stored in
+     */
+    std::string getPath(const FnAttribute::Attribute &key) const
+    {
+        return getHashPath(getKeyHash(key));
+    }
+
+    /**
+     * Returns the group attribute stored under the given key, or an invalid
+     * attribute if there is none. Can be called from concurrent cooks.
+     */
+    FnAttribute::GroupAttribute load(const FnAttribute::Attribute &key) const
+    {
+        const FnAttribute::Hash hash = getKeyHash(key);
+        std::unique_ptr<Mapping> mapping(new Mapping);
+        std::string error;
+        if (!mapping->file.open(getHashPath(hash), error))
+        {
+            return FnAttribute::GroupAttribute();
+        }
+
+        const char *data = static_cast<const char*>(mapping->file.data());
+        const size_t size = mapping->file.size();
+        FileHeader header;
+        if (size < sizeof(header))
+        {
+            return FnAttribute::GroupAttribute();
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(header.magic)) != 0 ||
+            header.formatVersion != kFormatVersion ||
+            header.byteOrder != kByteOrder ||
+            header.keyHash != hash.uint64() ||
+            header.fileSize != size ||
+            header.numberOfNodes == 0 ||
+            header.numberOfNodes > (size - sizeof(header)) / sizeof(Node) ||
+            header.dataOffset > size)
+        {
+            return FnAttribute::GroupAttribute();
+        }
+
+        Reader reader;
+        reader.nodes = reinterpret_cast<const Node*>(data + sizeof(header));
+        reader.numberOfNodes = header.numberOfNodes;
+        reader.data = data + header.dataOffset;
+        reader.dataSize = size - header.dataOffset;
+        reader.mapping = mapping.get();
+        reader.nextNode = 0;
+
+        // The mapping is released by the last attribute referencing it, or
+        // right away if none does
+        mapping->references.store(1);
+        Mapping *sharedMapping = mapping.release();
+        const FnAttribute::GroupAttribute attr = reader.readAttr();
+        Mapping::release(sharedMapping);
+        return attr;
+    }
+
+    /**
+     * Stores the given group attribute under the given key, replacing the
+     * one stored before, if any. Returns false if the file can't be written.
+     * Can be called from concurrent cooks.
+     */
+    bool store(const FnAttribute::Attribute &key,
+               const FnAttribute::GroupAttribute &attr)
+    {
+        Writer writer;
+        if (!writer.writeAttr(attr, std::string()))
+        {
+            return false;
+        }
+
+        const FnAttribute::Hash hash = getKeyHash(key);
+        FileHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.formatVersion = kFormatVersion;
+        header.byteOrder = kByteOrder;
+        header.keyHash = hash.uint64();
+        header.numberOfNodes = writer.nodes.size();
+        header.dataOffset = alignOffset(
+            sizeof(header) + writer.nodes.size() * sizeof(Node));
+        header.fileSize = header.dataOffset + writer.data.size();
+
+        const std::string path = getHashPath(hash);
+        std::string temporaryPath;
+        std::FILE *file = createTemporaryFile(path, temporaryPath);
+        if (!file)
+        {
+            return false;
+        }
+        const std::vector<char> padding(
+            header.dataOffset - sizeof(header) -
+            writer.nodes.size() * sizeof(Node), 0);
+        bool written =
+            std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(writer.nodes.data(), sizeof(Node),
+                        writer.nodes.size(), file) == writer.nodes.size() &&
+            std::fwrite(padding.data(), 1, padding.size(), file) ==
+                padding.size() &&
+            std::fwrite(writer.data.data(), 1, writer.data.size(), file) ==
+                writer.data.size();
+        written = std::fclose(file) == 0 && written;
+        if (!written || !replaceFile(temporaryPath, path))
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+
+    /// Bumped whenever the layout of the files, or of the attributes the
+    /// Ops store, changes
+    static const uint32_t kFormatVersion = 1;
+    static const uint32_t kByteOrder = 0x01020304u;
+    /// Alignment of the arrays in the files, in bytes
+    static const size_t kAlignment = 64;
+
+    static constexpr const char kMagic[8] = {
+        'K', 'O', 'P', 'C', 'A', 'C', 'H', 'E' };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t formatVersion;
+        uint32_t byteOrder;
+        uint64_t keyHash;
+        uint64_t numberOfNodes;
+        uint64_t dataOffset;
+        uint64_t fileSize;
+    };
+
+    /**
+     * One attribute of the stored tree, the children of groups following
+     * them, depth first. Offsets are relative to the data section: names
+     * are null-terminated, numeric values are stored one time sample after
+     * the other, after the sample times, and strings one after the other,
+     * null-terminated.
+     */
+    struct Node
+    {
+        int32_t type;
+        int32_t groupInherit;
+        /// Children of groups, values of the others
+        int64_t count;
+        int64_t tupleSize;
+        int64_t numberOfSamples;
+        uint64_t nameOffset;
+        uint64_t dataOffset;
+    };
+
+    /**
+     * A mapped file, referenced by the attributes holding its data
+     */
+    struct Mapping
+    {
+        MappedFile file;
+        std::atomic<int> references;
+
+        static void release(void *context)
+        {
+            Mapping *mapping = static_cast<Mapping*>(context);
+            if (mapping->references.fetch_sub(1) == 1)
+            {
+                delete mapping;
+            }
+        }
+    };
+
+    struct Writer
+    {
+        std::vector<Node> nodes;
+        std::vector<char> data;
+
+        uint64_t append(const void *values, size_t size)
+        {
+            const uint64_t offset = data.size();
+            data.insert(data.end(), static_cast<const char*>(values),
+                        static_cast<const char*>(values) + size);
+            return offset;
+        }
+
+        void align()
+        {
+            data.resize(alignOffset(data.size()), 0);
+        }
+
+        template <typename AttributeType>
+        void writeValues(const AttributeType &attr, Node &node)
+        {
+            typedef typename AttributeType::value_type ValueType;
+            node.count = attr.getNumberOfValues();
+            node.tupleSize = attr.getTupleSize();
+            node.numberOfSamples = attr.getNumberOfTimeSamples();
+            align();
+            node.dataOffset = data.size();
+            for (int64_t i = 0; i < node.numberOfSamples; ++i)
+            {
+                const float time = attr.getSampleTime(i);
+                append(&time, sizeof(time));
+            }
+            for (int64_t i = 0; i < node.numberOfSamples; ++i)
+            {
+                align();
+                const typename AttributeType::array_type values =
+                    attr.getNearestSample(attr.getSampleTime(i));
+                append(values.data(),
+                       static_cast<size_t>(node.count) * sizeof(ValueType));
+            }
+        }
+
+        bool writeAttr(const FnAttribute::Attribute &attr,
+                       const std::string &name)
+        {
+            Node node = Node();
+            node.type = attr.getType();
+            node.nameOffset = append(name.c_str(), name.size() + 1);
+
+            switch (node.type)
+            {
+            case kFnKatAttributeTypeInt:
+                writeValues(FnAttribute::IntAttribute(attr), node);
+                break;
+            case kFnKatAttributeTypeFloat:
+                writeValues(FnAttribute::FloatAttribute(attr), node);
+                break;
+            case kFnKatAttributeTypeDouble:
+                writeValues(FnAttribute::DoubleAttribute(attr), node);
+                break;
+            case kFnKatAttributeTypeString:
+            {
+                const FnAttribute::StringAttribute stringAttr(attr);
+                if (stringAttr.getNumberOfTimeSamples() != 1)
+                {
+                    return false;
+                }
+                const FnAttribute::StringConstVector values =
+                    stringAttr.getNearestSample(0.0f);
+                node.count = static_cast<int64_t>(values.size());
+                node.tupleSize = stringAttr.getTupleSize();
+                node.numberOfSamples = 1;
+                node.dataOffset = data.size();
+                for (size_t i = 0; i < values.size(); ++i)
+                {
+                    append(values[i], std::strlen(values[i]) + 1);
+                }
+                break;
+            }
+            case kFnKatAttributeTypeGroup:
+            {
+                const FnAttribute::GroupAttribute groupAttr(attr);
+                node.count = groupAttr.getNumberOfChildren();
+                node.groupInherit = groupAttr.getGroupInherit() ? 1 : 0;
+                nodes.push_back(node);
+                for (int64_t i = 0; i < node.count; ++i)
+                {
+                    if (!writeAttr(groupAttr.getChildByIndex(i),
+                                   groupAttr.getChildName(i)))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            default:
+                return false;
+            }
+            nodes.push_back(node);
+            return true;
+        }
+    };
+
+    struct Reader
+    {
+        const Node *nodes;
+        uint64_t numberOfNodes;
+        const char *data;
+        uint64_t dataSize;
+        Mapping *mapping;
+        uint64_t nextNode;
+
+        bool hasData(uint64_t offset, uint64_t size) const
+        {
+            return offset <= dataSize && size <= dataSize - offset;
+        }
+
+        const char* getName(const Node &node) const
+        {
+            if (node.nameOffset >= dataSize ||
+                !std::memchr(data + node.nameOffset, '\0',
+                             dataSize - node.nameOffset))
+            {
+                return nullptr;
+            }
+            return data + node.nameOffset;
+        }
+
+        template <typename AttributeType>
+        FnAttribute::Attribute readValues(const Node &node)
+        {
+            typedef typename AttributeType::value_type ValueType;
+            if (node.count < 0 || node.tupleSize <= 0 ||
+                node.numberOfSamples <= 0 ||
+                node.numberOfSamples > 1024 ||
+                node.count > int64_t(1) << 40 ||
+                !hasData(node.dataOffset,
+                         node.numberOfSamples * sizeof(float)))
+            {
+                return FnAttribute::Attribute();
+            }
+
+            const float *times =
+                reinterpret_cast<const float*>(data + node.dataOffset);
+            std::vector<const ValueType*> samples(
+                static_cast<size_t>(node.numberOfSamples));
+            uint64_t offset =
+                node.dataOffset + node.numberOfSamples * sizeof(float);
+            for (size_t i = 0; i < samples.size(); ++i)
+            {
+                offset = alignOffset(offset);
+                const uint64_t size = node.count * sizeof(ValueType);
+                if (!hasData(offset, size))
+                {
+                    return FnAttribute::Attribute();
+                }
+                samples[i] = reinterpret_cast<const ValueType*>(data + offset);
+                offset += size;
+            }
+
+            if constexpr (kZeroCopyAttributes)
+            {
+                mapping->references.fetch_add(1);
+                return AttributeType(times, node.numberOfSamples,
+                                     samples.data(), node.count,
+                                     node.tupleSize, mapping,
+                                     &Mapping::release);
+            }
+            else
+            {
+                return AttributeType(times, node.numberOfSamples,
+                                     samples.data(), node.count,
+                                     node.tupleSize);
+            }
+        }
+
+        FnAttribute::Attribute readStrings(const Node &node)
+        {
+            if (node.count < 0 || node.tupleSize <= 0 ||
+                static_cast<uint64_t>(node.count) > dataSize)
+            {
+                return FnAttribute::Attribute();
+            }
+            std::vector<std::string> values(static_cast<size_t>(node.count));
+            uint64_t offset = node.dataOffset;
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                if (offset >= dataSize)
+                {
+                    return FnAttribute::Attribute();
+                }
+                const char *value = data + offset;
+                const void *end = std::memchr(value, '\0', dataSize - offset);
+                if (!end)
+                {
+                    return FnAttribute::Attribute();
+                }
+                values[i].assign(value, static_cast<const char*>(end));
+                offset += values[i].size() + 1;
+            }
+            return FnAttribute::StringAttribute(values, node.tupleSize);
+        }
+
+        /**
+         * Reads the next node, and its children, returns an invalid
+         * attribute if they are malformed
+         */
+        FnAttribute::Attribute readAttr()
+        {
+            if (nextNode >= numberOfNodes)
+            {
+                return FnAttribute::Attribute();
+            }
+            const Node &node = nodes[nextNode++];
+            switch (node.type)
+            {
+            case kFnKatAttributeTypeInt:
+                return readValues<FnAttribute::IntAttribute>(node);
+            case kFnKatAttributeTypeFloat:
+                return readValues<FnAttribute::FloatAttribute>(node);
+            case kFnKatAttributeTypeDouble:
+                return readValues<FnAttribute::DoubleAttribute>(node);
+            case kFnKatAttributeTypeString:
+                return readStrings(node);
+            case kFnKatAttributeTypeGroup:
+            {
+                if (node.count < 0 ||
+                    static_cast<uint64_t>(node.count) >
+                        numberOfNodes - nextNode)
+                {
+                    return FnAttribute::Attribute();
+                }
+                FnAttribute::GroupAttribute::NamedAttrVector_Type children;
+                children.reserve(static_cast<size_t>(node.count));
+                for (int64_t i = 0; i < node.count; ++i)
+                {
+                    const char *name = getName(nodes[nextNode]);
+                    FnAttribute::Attribute child = readAttr();
+                    if (!name || !child.isValid())
+                    {
+                        return FnAttribute::Attribute();
+                    }
+                    children.push_back(
+                        FnAttribute::GroupAttribute::NamedAttr_Type(
+                            name, child));
+                }
+                return FnAttribute::GroupAttribute(children,
+                                                   node.groupInherit != 0);
+            }
+            default:
+                return FnAttribute::Attribute();
+            }
+        }
+    };
+
+    static uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    static AttributeCache* createDefault()
+    {
+        const char *directory = std::getenv("KATANAOPS_CACHE_DIR");
+        if (!directory || !*directory)
+        {
+            return nullptr;
+        }
+        // Never destroyed, like the other process-wide state of the Ops
+        return new AttributeCache(directory);
+    }
+
+    static FnAttribute::Hash getKeyHash(const FnAttribute::Attribute &key)
+    {
+        // Keys of another version of the format don't match
+        return FnAttribute::GroupAttribute(
+            "formatVersion",
+            FnAttribute::IntAttribute(static_cast<int>(kFormatVersion)),
+            "key", key,
+            true).getHash();
+    }
+
+    std::string getHashPath(const FnAttribute::Hash &hash) const
+    {
+        return m_directory + "/" + hash.str() + ".kac";
+    }
+
+    AttributeCache(const AttributeCache&);
+    AttributeCache& operator=(const AttributeCache&);
+
+    const std::string m_directory;
+};
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_ATTRIBUTECACHE_H
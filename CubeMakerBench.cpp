@@ -0,0 +1,861 @@
+// Benchmarks for the CubeMaker Op cook paths.
+//
+// The Op cook logic is driven through MockCookInterface (see
+// MockCookInterface.h), a minimal stand-in for the GeolibCookInterface that
+// counts what the Op produces, so that the building blocks and each of the
+// 'c', 'a' and 'leaf' branches can be timed without a Geolib runtime.
+//
+// Besides the time per iteration, the benchmarks report:
+//
+// - allocs/op: heap allocations made through operator new per iteration
+// - locations/s: the rate at which child locations are created, for the
+//   benchmarks generating cubes
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <FnAttribute/FnAttribute.h>
+#include <FnAttribute/FnGroupBuilder.h>
+
+#include "AttributeCache.h"
+#include "CubeMakerKernels.h"
+#include "CubeMakerOp.h"
+#include "CubeMakerProcedural.h"
+#include "MockCookInterface.h"
+
+namespace { //anonymous
+
+std::atomic<unsigned long long> g_allocations(0);
+
+} // anonymous
+
+// Count all the allocations going through the global operator new, which
+// includes the ones made by the FnAttribute library on our behalf
+void* operator new(std::size_t size)
+{
+    ++g_allocations;
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    ++g_allocations;
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// Once inlined in optimized builds, GCC sees memory from operator new given
+// to free(), not knowing the two operators are replaced together
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+namespace { //anonymous
+
+using KatanaOps::MockCookInterface;
+
+/**
+ * Exposes the protected building blocks of the Op to the benchmarks
+ */
+struct CubeMakerOpAccess : public CubeMaker::CubeMakerOp
+{
+    using CubeMakerOp::buildGeometry;
+    using CubeMakerOp::buildMeshGeometry;
+    using CubeMakerOp::getCachedGeometry;
+    using CubeMakerOp::getCachedMesh;
+    using CubeMakerOp::getCachedMeshBound;
+    using CubeMakerOp::getCachedMeshType;
+    using CubeMakerOp::getCachedRotateY;
+    using CubeMakerOp::getCachedRotateZ;
+    using CubeMakerOp::buildTransform;
+    using CubeMakerOp::buildTransformMatrix;
+    using CubeMakerOp::buildBatch;
+};
+
+/**
+ * Records the number of allocations made while in scope and reports them,
+ * averaged over the iterations, as the 'allocs/op' counter
+ */
+class AllocationCounter
+{
+public:
+
+    explicit AllocationCounter(benchmark::State &state)
+        : m_state(state), m_start(g_allocations.load())
+    {
+    }
+
+    ~AllocationCounter()
+    {
+        m_state.counters["allocs/op"] = benchmark::Counter(
+            static_cast<double>(g_allocations.load() - m_start),
+            benchmark::Counter::kAvgIterations);
+    }
+
+private:
+
+    benchmark::State &m_state;
+    unsigned long long m_start;
+};
+
+/**
+ * Reports the rate at which locations were created by the given mock
+ * interfaces as the 'locations/s' counter
+ */
+void reportLocations(benchmark::State &state, long long numLocations)
+{
+    state.counters["locations/s"] = benchmark::Counter(
+        static_cast<double>(numLocations), benchmark::Counter::kIsRate);
+}
+
+FnAttribute::GroupAttribute buildCubesArgs(int numberOfCubes, int bucketSize,
+                                           const std::string &outputMode)
+{
+    FnAttribute::GroupBuilder gb;
+    gb.set("a.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("a.maxRotation", FnAttribute::DoubleAttribute(90.0));
+    gb.set("a.bucketSize", FnAttribute::IntAttribute(bucketSize));
+    gb.set("a.outputMode", FnAttribute::StringAttribute(outputMode));
+    return gb.build();
+}
+
+//------------------------------------------------------------------------------
+// Building blocks
+
+void BM_BuildGeometry(benchmark::State &state)
+{
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(CubeMakerOpAccess::buildGeometry());
+    }
+}
+BENCHMARK(BM_BuildGeometry);
+
+void BM_CachedGeometry(benchmark::State &state)
+{
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        FnAttribute::GroupAttribute geometry =
+            CubeMakerOpAccess::getCachedGeometry().get();
+        benchmark::DoNotOptimize(geometry);
+    }
+}
+BENCHMARK(BM_CachedGeometry);
+
+void BM_BuildMeshGeometry(benchmark::State &state)
+{
+    // Sharp meshes of the common levels come from the compile-time tables,
+    // rounded ones are always built at runtime
+    const int level = static_cast<int>(state.range(0));
+    const double roundness = state.range(1) * 0.01;
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            CubeMakerOpAccess::buildMeshGeometry(level, roundness));
+    }
+}
+BENCHMARK(BM_BuildMeshGeometry)
+    ->ArgsProduct({ { 0, 2, 4, 6 }, { 0, 25 } })
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_BuildTransform(benchmark::State &state)
+{
+    CubeMaker::Placement placement;
+    placement.mode = static_cast<CubeMaker::Placement::Mode>(state.range(0));
+
+    AllocationCounter allocationCounter(state);
+    int index = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            CubeMakerOpAccess::buildTransform(index, 45.0, placement));
+        index = (index + 1) & 1023;
+    }
+}
+BENCHMARK(BM_BuildTransform)
+    ->Arg(CubeMaker::Placement::kModeLine)
+    ->Arg(CubeMaker::Placement::kModeBox)
+    ->Arg(CubeMaker::Placement::kModeSphere);
+
+void BM_BuildTransformMatrix(benchmark::State &state)
+{
+    CubeMaker::Placement placement;
+    placement.mode = static_cast<CubeMaker::Placement::Mode>(state.range(0));
+
+    AllocationCounter allocationCounter(state);
+    int index = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            CubeMakerOpAccess::buildTransformMatrix(index, 45.0, placement));
+        index = (index + 1) & 1023;
+    }
+}
+BENCHMARK(BM_BuildTransformMatrix)
+    ->Arg(CubeMaker::Placement::kModeLine)
+    ->Arg(CubeMaker::Placement::kModeBox)
+    ->Arg(CubeMaker::Placement::kModeSphere);
+
+void BM_FillInstanceTransforms(benchmark::State &state)
+{
+    const CubeMaker::KernelIsa isa =
+        static_cast<CubeMaker::KernelIsa>(state.range(0));
+    if (!CubeMaker::isKernelIsaSupported(isa))
+    {
+        state.SkipWithError("Instruction set not supported");
+        return;
+    }
+    const CubeMaker::InstanceKernels &kernels =
+        CubeMaker::getInstanceKernels(isa);
+    state.SetLabel(kernels.name);
+
+    CubeMaker::Placement placement;
+    placement.numberOfCubes = static_cast<int>(state.range(1));
+    placement.rotationStep = 90.0 / placement.numberOfCubes;
+
+    const size_t count = static_cast<size_t>(placement.numberOfCubes);
+    std::vector<double> translate(count * 3);
+    std::vector<double> rotateX(count * 4);
+    std::vector<double> rotateY(count * 4);
+    std::vector<double> rotateZ(count * 4);
+    std::vector<double> scale(count * 3);
+
+    for (auto _ : state)
+    {
+        kernels.fillTransforms(placement, 0, count, translate.data(),
+                               rotateX.data(), rotateY.data(),
+                               rotateZ.data(), scale.data());
+        benchmark::ClobberMemory();
+    }
+    state.counters["instances/s"] = benchmark::Counter(
+        static_cast<double>(count) * state.iterations(),
+        benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_FillInstanceTransforms)
+    ->ArgsProduct({ { CubeMaker::kKernelIsaScalar, CubeMaker::kKernelIsaSse2,
+                      CubeMaker::kKernelIsaAvx2 },
+                    { 1000, 1000000 } })
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_FillInstanceMatrices(benchmark::State &state)
+{
+    const CubeMaker::KernelIsa isa =
+        static_cast<CubeMaker::KernelIsa>(state.range(0));
+    if (!CubeMaker::isKernelIsaSupported(isa))
+    {
+        state.SkipWithError("Instruction set not supported");
+        return;
+    }
+    const CubeMaker::InstanceKernels &kernels =
+        CubeMaker::getInstanceKernels(isa);
+    state.SetLabel(kernels.name);
+
+    CubeMaker::Placement placement;
+    placement.numberOfCubes = static_cast<int>(state.range(1));
+
+    const size_t count = static_cast<size_t>(placement.numberOfCubes);
+    std::vector<double> matrix(count * 16);
+
+    for (auto _ : state)
+    {
+        kernels.fillMatrices(placement, 0, count, matrix.data());
+        benchmark::ClobberMemory();
+    }
+    state.counters["instances/s"] = benchmark::Counter(
+        static_cast<double>(count) * state.iterations(),
+        benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_FillInstanceMatrices)
+    ->ArgsProduct({ { CubeMaker::kKernelIsaScalar, CubeMaker::kKernelIsaSse2,
+                      CubeMaker::kKernelIsaAvx2 },
+                    { 1000, 1000000 } })
+    ->Unit(benchmark::kMicrosecond);
+
+//------------------------------------------------------------------------------
+// Cook branches
+
+void BM_CookHierarchy(benchmark::State &state)
+{
+    FnAttribute::GroupBuilder gb;
+    gb.set("c.world.c.geo.c.cubeMaker.a.numberOfCubes",
+           FnAttribute::IntAttribute(20));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookHierarchy);
+
+void BM_CookLocationPath(benchmark::State &state)
+{
+    FnAttribute::GroupBuilder gb;
+    gb.set("location",
+           FnAttribute::StringAttribute("/root/world/geo/cubeMaker"));
+    gb.set("a.numberOfCubes", FnAttribute::IntAttribute(20));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookLocationPath);
+
+/**
+ * Builds the 'sets' Op argument of the given number of sets, spread over 16
+ * groups
+ */
+FnAttribute::GroupAttribute buildSetsArgs(int numberOfSets)
+{
+    FnAttribute::GroupBuilder gb;
+    for (int i = 0; i < numberOfSets; ++i)
+    {
+        const std::string setName = "sets.set" + std::to_string(i);
+        gb.set(setName + ".location", FnAttribute::StringAttribute(
+            "/root/world/geo/group" + std::to_string(i % 16) + "/set" +
+            std::to_string(i)));
+        gb.set(setName + ".a.numberOfCubes", FnAttribute::IntAttribute(20));
+    }
+    return gb.build();
+}
+
+void BM_CookBatchRoot(benchmark::State &state)
+{
+    const FnAttribute::GroupAttribute opArgs =
+        buildSetsArgs(static_cast<int>(state.range(0)));
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookBatchRoot)->Arg(10)->Arg(1000);
+
+void BM_CookBatch(benchmark::State &state)
+{
+    const FnAttribute::GroupAttribute setsAttr =
+        buildSetsArgs(static_cast<int>(state.range(0)));
+    const FnAttribute::GroupAttribute opArgs(
+        "batch", CubeMakerOpAccess::buildBatch(
+            setsAttr.getChildByName("sets")),
+        true);
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root/world/geo/group3");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookBatch)->Arg(10)->Arg(1000);
+
+void BM_CookCubes(benchmark::State &state)
+{
+    const FnAttribute::GroupAttribute opArgs = buildCubesArgs(
+        static_cast<int>(state.range(0)), 0, "locations");
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookCubes)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+void BM_CookBuckets(benchmark::State &state)
+{
+    const FnAttribute::GroupAttribute opArgs = buildCubesArgs(
+        static_cast<int>(state.range(0)), 1024, "locations");
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookBuckets)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_BuildCubeGrid(benchmark::State &state)
+{
+    CubeMaker::Placement placement;
+    placement.mode = CubeMaker::Placement::kModeBox;
+    placement.scatterSize = 100.0;
+    placement.numberOfCubes = static_cast<int>(state.range(0));
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        CubeMaker::CubeGrid grid(placement);
+        benchmark::DoNotOptimize(grid.getDepth());
+    }
+}
+BENCHMARK(BM_BuildCubeGrid)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+FnAttribute::GroupAttribute buildSpatialCubesArgs(int numberOfCubes,
+                                                  int bucketSize)
+{
+    FnAttribute::GroupBuilder gb;
+    gb.set("a.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("a.bucketSize", FnAttribute::IntAttribute(bucketSize));
+    gb.set("a.spatialBuckets", FnAttribute::IntAttribute(1));
+    gb.set("a.placement", FnAttribute::StringAttribute("box"));
+    gb.set("a.scatterSize", FnAttribute::DoubleAttribute(100.0));
+    return gb.build();
+}
+
+// Includes building the grid, which the base location does on each cook
+void BM_CookSpatialBuckets(benchmark::State &state)
+{
+    const FnAttribute::GroupAttribute opArgs = buildSpatialCubesArgs(
+        static_cast<int>(state.range(0)), 1024);
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookSpatialBuckets)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+// A spatial group sharing the grid of its base location, holding 1/64th of
+// the cubes
+void BM_CookSpatialGroup(benchmark::State &state)
+{
+    const int numberOfCubes = static_cast<int>(state.range(0));
+
+    CubeMaker::Placement placement;
+    placement.mode = CubeMaker::Placement::kModeBox;
+    placement.scatterSize = 100.0;
+    placement.numberOfCubes = numberOfCubes;
+    std::shared_ptr<const CubeMaker::CubeGrid> grid =
+        std::make_shared<CubeMaker::CubeGrid>(placement);
+
+    FnAttribute::GroupBuilder gb;
+    gb.set("a.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("a.bucketSize", FnAttribute::IntAttribute(1024));
+    gb.set("a.spatialBuckets", FnAttribute::IntAttribute(1));
+    gb.set("a.spatialLevel", FnAttribute::IntAttribute(2));
+    gb.set("a.spatialNode", FnAttribute::IntAttribute(21));
+    gb.set("params.placement", FnAttribute::StringAttribute("box"));
+    gb.set("params.scatterSize", FnAttribute::DoubleAttribute(100.0));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/group_0/group_5", &grid);
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookSpatialGroup)
+    ->RangeMultiplier(10)->Range(100000, 10000000)
+    ->Unit(benchmark::kMicrosecond);
+
+// Expands the cubes of a region holding about 1/1000th of them
+void BM_CookRegionOfInterest(benchmark::State &state)
+{
+    const double region[] = { -5.0, 5.0, -5.0, 5.0, -5.0, 5.0 };
+    FnAttribute::GroupBuilder gb;
+    gb.set("a.numberOfCubes",
+           FnAttribute::IntAttribute(static_cast<int>(state.range(0))));
+    gb.set("a.regionOfInterest", FnAttribute::DoubleAttribute(region, 6, 2));
+    gb.set("a.placement", FnAttribute::StringAttribute("box"));
+    gb.set("a.scatterSize", FnAttribute::DoubleAttribute(100.0));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    long long numLocations = 0;
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+        numLocations += interface.getNumChildren();
+    }
+    reportLocations(state, numLocations);
+}
+BENCHMARK(BM_CookRegionOfInterest)
+    ->RangeMultiplier(10)->Range(1000, 10000000)
+    ->Unit(benchmark::kMicrosecond);
+
+// The same region, expanded by a renderer procedural from its arguments,
+// once the grid is built
+void BM_ExpandProceduralRegion(benchmark::State &state)
+{
+    const double region[] = { -5.0, 5.0, -5.0, 5.0, -5.0, 5.0 };
+    CubeMaker::ProceduralArgs args;
+    const double numberOfCubes = static_cast<double>(state.range(0));
+    const double scatterSize = 100.0;
+    CubeMaker::setProceduralArg(args, "numberOfCubes", &numberOfCubes, 1);
+    CubeMaker::setProceduralArg(args, "placement", "box");
+    CubeMaker::setProceduralArg(args, "scatterSize", &scatterSize, 1);
+    CubeMaker::CubeExpander expander(args);
+    std::string error;
+    expander.open(error);
+    std::vector<int> cubes;
+    expander.getCubesInRegion(region, cubes);
+
+    AllocationCounter allocationCounter(state);
+    long long numCubes = 0;
+    double matrix[16];
+    for (auto _ : state)
+    {
+        cubes.clear();
+        expander.getCubesInRegion(region, cubes);
+        for (size_t i = 0; i < cubes.size(); ++i)
+        {
+            expander.getCubeMatrices(cubes[i], matrix);
+            benchmark::DoNotOptimize(matrix[0]);
+        }
+        numCubes += static_cast<long long>(cubes.size());
+    }
+    reportLocations(state, numCubes);
+}
+BENCHMARK(BM_ExpandProceduralRegion)
+    ->RangeMultiplier(10)->Range(1000, 10000000)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_CookMemoryReport(benchmark::State &state)
+{
+    FnAttribute::GroupBuilder gb;
+    gb.update(buildCubesArgs(static_cast<int>(state.range(0)), 1000,
+                             "locations"));
+    gb.set("a.memoryReport", FnAttribute::IntAttribute(1));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    for (auto _ : state)
+    {
+        MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+}
+BENCHMARK(BM_CookMemoryReport)
+    ->RangeMultiplier(100)->Range(1000, 10000000)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_CookInstanceArray(benchmark::State &state)
+{
+    const int numberOfCubes = static_cast<int>(state.range(0));
+
+    FnAttribute::GroupBuilder gb;
+    gb.set("instances.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("params.rotationStep",
+           FnAttribute::DoubleAttribute(90.0 / numberOfCubes));
+    gb.set("instances.instanceSource", FnAttribute::StringAttribute(
+        "/root/world/geo/cubeMaker/instanceSource"));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/instances");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+    state.counters["instances/s"] = benchmark::Counter(
+        static_cast<double>(numberOfCubes) * state.iterations(),
+        benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CookInstanceArray)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+void BM_CookInstanceArrayPrimvars(benchmark::State &state)
+{
+    const int numberOfCubes = static_cast<int>(state.range(0));
+
+    FnAttribute::GroupBuilder gb;
+    gb.set("instances.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("params.rotationStep",
+           FnAttribute::DoubleAttribute(90.0 / numberOfCubes));
+    gb.set("params.displayColor", FnAttribute::IntAttribute(1));
+    gb.set("params.instanceId", FnAttribute::IntAttribute(1));
+    gb.set("instances.instanceSource", FnAttribute::StringAttribute(
+        "/root/world/geo/cubeMaker/instanceSource"));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/instances");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+    state.counters["instances/s"] = benchmark::Counter(
+        static_cast<double>(numberOfCubes) * state.iterations(),
+        benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CookInstanceArrayPrimvars)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+void BM_CookInstanceArrayPoints(benchmark::State &state)
+{
+    const int numberOfCubes = static_cast<int>(state.range(0));
+
+    // Points spread on a grid, written to the working directory
+    std::vector<float> records(static_cast<size_t>(numberOfCubes) * 4);
+    for (int i = 0; i < numberOfCubes; ++i)
+    {
+        records[i * 4] = static_cast<float>(i % 1000);
+        records[i * 4 + 1] = static_cast<float>(i / 1000 % 1000);
+        records[i * 4 + 2] = static_cast<float>(i / 1000000);
+        records[i * 4 + 3] = 0.5f + (i % 7) * 0.1f;
+    }
+    const std::string pointFile =
+        "CubeMakerBench_" + std::to_string(numberOfCubes) + ".kopc";
+    std::string error;
+    if (!CubeMaker::writePointFile(pointFile, records.data(), numberOfCubes,
+                                   error))
+    {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    FnAttribute::GroupBuilder gb;
+    gb.set("instances.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("params.placement", FnAttribute::StringAttribute("points"));
+    gb.set("params.pointFile", FnAttribute::StringAttribute(pointFile));
+    gb.set("instances.instanceSource", FnAttribute::StringAttribute(
+        "/root/world/geo/cubeMaker/instanceSource"));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/instances");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+    state.counters["instances/s"] = benchmark::Counter(
+        static_cast<double>(numberOfCubes) * state.iterations(),
+        benchmark::Counter::kIsRate);
+
+    // The file stays mapped, which unlinking doesn't prevent on POSIX
+    std::remove(pointFile.c_str());
+}
+BENCHMARK(BM_CookInstanceArrayPoints)
+    ->RangeMultiplier(10)->Range(100, 1000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+// Loading the instance array, as stored by BM_CookInstanceArray sized
+// cooks, back from an attribute cache in the working directory
+void BM_LoadCachedInstanceArray(benchmark::State &state)
+{
+    const int numberOfCubes = static_cast<int>(state.range(0));
+
+    FnAttribute::GroupBuilder gb;
+    gb.set("instances.numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+    gb.set("params.rotationStep",
+           FnAttribute::DoubleAttribute(90.0 / numberOfCubes));
+    gb.set("instances.instanceSource", FnAttribute::StringAttribute(
+        "/root/world/geo/cubeMaker/instanceSource"));
+    const FnAttribute::GroupAttribute opArgs = gb.build();
+
+    MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker/instances");
+    interface.recordAttrs();
+    CubeMaker::CubeMakerOp::cookLocation(interface);
+    const FnAttribute::GroupAttribute keyAttr(
+        "instances", opArgs.getChildByName("instances"),
+        "params", opArgs.getChildByName("params"),
+        true);
+    KatanaOps::AttributeCache cache(".");
+    if (!cache.store(keyAttr, FnAttribute::GroupAttribute(
+            "geometry", interface.getAttr("geometry"), true)))
+    {
+        state.SkipWithError("Can't write the cache file");
+        return;
+    }
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        FnAttribute::GroupAttribute cachedAttr = cache.load(keyAttr);
+        benchmark::DoNotOptimize(cachedAttr.isValid());
+    }
+    state.counters["instances/s"] = benchmark::Counter(
+        static_cast<double>(numberOfCubes) * state.iterations(),
+        benchmark::Counter::kIsRate);
+
+    std::remove(cache.getPath(keyAttr).c_str());
+}
+BENCHMARK(BM_LoadCachedInstanceArray)
+    ->RangeMultiplier(10)->Range(100, 10000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+void BM_CookLeaf(benchmark::State &state)
+{
+    FnAttribute::GroupBuilder paramsBuilder;
+    paramsBuilder.set("rotationStep", FnAttribute::DoubleAttribute(0.09));
+    paramsBuilder.set("xformMatrix",
+                      FnAttribute::IntAttribute(static_cast<int>(state.range(0))));
+    const FnAttribute::GroupAttribute opArgs(
+        "leaf", FnAttribute::IntAttribute(500),
+        "params", paramsBuilder.build(),
+        true);
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/cube_500");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+}
+BENCHMARK(BM_CookLeaf)->Arg(0)->Arg(1);
+
+void BM_CookLeafPrimvars(benchmark::State &state)
+{
+    FnAttribute::GroupBuilder paramsBuilder;
+    paramsBuilder.set("rotationStep", FnAttribute::DoubleAttribute(0.09));
+    paramsBuilder.set("displayColor", FnAttribute::IntAttribute(1));
+    paramsBuilder.set("instanceId", FnAttribute::IntAttribute(1));
+    const FnAttribute::GroupAttribute opArgs(
+        "leaf", FnAttribute::IntAttribute(500),
+        "params", paramsBuilder.build(),
+        true);
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/cube_500");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+}
+BENCHMARK(BM_CookLeafPrimvars);
+
+void BM_CookLeafMotion(benchmark::State &state)
+{
+    const double translationSpeed[] = { 0.0, 0.5, 0.0 };
+    FnAttribute::GroupBuilder paramsBuilder;
+    paramsBuilder.set("rotationStep", FnAttribute::DoubleAttribute(0.09));
+    paramsBuilder.set("xformMatrix",
+                      FnAttribute::IntAttribute(static_cast<int>(state.range(0))));
+    paramsBuilder.set("frame", FnAttribute::DoubleAttribute(12.0));
+    paramsBuilder.set("rotationSpeed", FnAttribute::DoubleAttribute(5.0));
+    paramsBuilder.set("translationSpeed",
+                      FnAttribute::DoubleAttribute(translationSpeed, 3, 3));
+    paramsBuilder.set("motionSamples",
+                      FnAttribute::IntAttribute(static_cast<int>(state.range(1))));
+    paramsBuilder.set("shutterOpen", FnAttribute::DoubleAttribute(-0.25));
+    paramsBuilder.set("shutterClose", FnAttribute::DoubleAttribute(0.25));
+    const FnAttribute::GroupAttribute opArgs(
+        "leaf", FnAttribute::IntAttribute(500),
+        "params", paramsBuilder.build(),
+        true);
+
+    AllocationCounter allocationCounter(state);
+    for (auto _ : state)
+    {
+        MockCookInterface interface(
+            opArgs, "/root/world/geo/cubeMaker/cube_500");
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+    }
+}
+BENCHMARK(BM_CookLeafMotion)->ArgsProduct({ { 0, 1 }, { 2, 8 } });
+
+} // anonymous
+
+int main(int argc, char **argv)
+{
+    // The FnAttribute library needs to be bootstrapped when used outside
+    // of a Katana process
+    const char *katanaRoot = std::getenv("KATANA_ROOT");
+    if (!FnAttribute::Bootstrap(katanaRoot ? katanaRoot
+                                           : CUBEMAKER_BENCH_KATANA_ROOT))
+    {
+        return 1;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
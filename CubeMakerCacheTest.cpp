@@ -0,0 +1,194 @@
+// Checks the on-disk format of the attribute cache.
+//
+// Stores the arrays of a CubeMaker instance array, cooked through
+// MockCookInterface with motion samples and primvars, in an AttributeCache
+// in the working directory, and checks that loading them back returns an
+// equal attribute, and that truncated files, or files with a wrong magic,
+// format version or key hash, are misses rather than garbage. Run by ctest;
+// exits with a non-zero status if any check fails.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+#include <FnAttribute/FnGroupBuilder.h>
+
+#include "AttributeCache.h"
+#include "CubeMakerOp.h"
+#include "MockCookInterface.h"
+
+namespace { //anonymous
+
+using KatanaOps::MockCookInterface;
+
+// Offsets of the fields of the file header, see AttributeCache::FileHeader
+const long kMagicOffset = 0;
+const long kFormatVersionOffset = 8;
+const long kKeyHashOffset = 16;
+
+int g_failures = 0;
+
+void check(bool condition, const char *message)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", message);
+        ++g_failures;
+    }
+}
+
+bool readFile(const std::string &path, std::vector<char> &content)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    content.clear();
+    char buffer[65536];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.insert(content.end(), buffer, buffer + count);
+    }
+    std::fclose(file);
+    return true;
+}
+
+bool writeFile(const std::string &path, const char *data, size_t size)
+{
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    const bool written = std::fwrite(data, 1, size, file) == size;
+    return std::fclose(file) == 0 && written;
+}
+
+/**
+ * Writes the given file content, with the 32 bits at the given offset
+ * flipped, to the given path
+ */
+bool writeCorruptedFile(const std::string &path,
+                        const std::vector<char> &content, long offset)
+{
+    std::vector<char> corrupted(content);
+    for (long i = offset; i < offset + 4; ++i)
+    {
+        corrupted[i] = static_cast<char>(~corrupted[i]);
+    }
+    return writeFile(path, corrupted.data(), corrupted.size());
+}
+
+/**
+ * Returns the attributes of an instance array location, as the Op caches
+ * them, cooked with 3 motion samples and both primvars
+ */
+FnAttribute::GroupAttribute cookInstanceArray(
+    FnAttribute::GroupAttribute &keyAttr)
+{
+    const int numberOfCubes = 1000;
+    FnAttribute::GroupBuilder paramsBuilder;
+    paramsBuilder.set("rotationStep",
+                      FnAttribute::DoubleAttribute(90.0 / numberOfCubes));
+    const double translationSpeed[] = { 1.0, 0.5, 0.0 };
+    paramsBuilder.set("translationSpeed",
+                      FnAttribute::DoubleAttribute(translationSpeed, 3, 3));
+    paramsBuilder.set("motionSamples", FnAttribute::IntAttribute(3));
+    paramsBuilder.set("shutterOpen", FnAttribute::DoubleAttribute(-0.25));
+    paramsBuilder.set("shutterClose", FnAttribute::DoubleAttribute(0.25));
+    paramsBuilder.set("displayColor", FnAttribute::IntAttribute(1));
+    paramsBuilder.set("instanceId", FnAttribute::IntAttribute(1));
+
+    FnAttribute::GroupBuilder instancesBuilder;
+    instancesBuilder.set("numberOfCubes",
+                         FnAttribute::IntAttribute(numberOfCubes));
+    instancesBuilder.set("instanceSource", FnAttribute::StringAttribute(
+        "/root/world/geo/cubeMaker/instanceSource"));
+
+    const FnAttribute::GroupAttribute opArgs(
+        "instances", instancesBuilder.build(),
+        "params", paramsBuilder.build(),
+        true);
+    MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker/instances");
+    interface.recordAttrs();
+    CubeMaker::CubeMakerOp::cookLocation(interface);
+
+    keyAttr = opArgs;
+    return FnAttribute::GroupAttribute(
+        "geometry", interface.getAttr("geometry"),
+        "arbitrary", interface.getAttr("instance.arbitrary"),
+        true);
+}
+
+} // anonymous
+
+int main()
+{
+    // The FnAttribute library needs to be bootstrapped when used outside
+    // of a Katana process
+    const char *katanaRoot = std::getenv("KATANA_ROOT");
+    if (!FnAttribute::Bootstrap(katanaRoot ? katanaRoot
+                                           : CUBEMAKER_TEST_KATANA_ROOT))
+    {
+        std::fprintf(stderr, "Cannot bootstrap the FnAttribute library.\n");
+        return 1;
+    }
+
+    FnAttribute::GroupAttribute keyAttr;
+    const FnAttribute::GroupAttribute attr = cookInstanceArray(keyAttr);
+    check(attr.getChildByName("geometry").isValid() &&
+          attr.getChildByName("arbitrary").isValid(),
+          "cooked instance array has geometry and primvars");
+
+    KatanaOps::AttributeCache cache(".");
+    const std::string path = cache.getPath(keyAttr);
+    check(cache.store(keyAttr, attr), "store() writes the file");
+
+    const FnAttribute::GroupAttribute loadedAttr = cache.load(keyAttr);
+    check(loadedAttr.isValid(), "load() finds the stored file");
+    check(loadedAttr == attr, "load() returns an equal attribute");
+    check(!cache.load(FnAttribute::StringAttribute("other")).isValid(),
+          "load() misses for another key");
+
+    std::vector<char> content;
+    check(readFile(path, content) && content.size() > 64,
+          "stored file can be read");
+    if (content.size() > 64)
+    {
+        check(writeFile(path, content.data(), content.size() / 2) &&
+              !cache.load(keyAttr).isValid(),
+              "truncated file is a miss");
+        check(writeFile(path, content.data(), 32) &&
+              !cache.load(keyAttr).isValid(),
+              "file truncated within its header is a miss");
+        check(writeCorruptedFile(path, content, kMagicOffset) &&
+              !cache.load(keyAttr).isValid(),
+              "file with a wrong magic is a miss");
+        check(writeCorruptedFile(path, content, kFormatVersionOffset) &&
+              !cache.load(keyAttr).isValid(),
+              "file with a wrong format version is a miss");
+        check(writeCorruptedFile(path, content, kKeyHashOffset) &&
+              !cache.load(keyAttr).isValid(),
+              "file with a wrong key hash is a miss");
+
+        // The same content is a hit again, the checks above not depending
+        // on the state of the cache
+        check(writeFile(path, content.data(), content.size()) &&
+              cache.load(keyAttr) == attr,
+              "restored file is a hit");
+    }
+    std::remove(path.c_str());
+
+    if (g_failures > 0)
+    {
+        std::fprintf(stderr, "%d checks failed.\n", g_failures);
+        return 1;
+    }
+    std::printf("Attribute cache checks passed.\n");
+    return 0;
+}
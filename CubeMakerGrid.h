@@ -0,0 +1,379 @@
+#ifndef KATANAOPS_CUBEMAKERGRID_H
+#define KATANAOPS_CUBEMAKERGRID_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "CubeMakerPlacement.h"
+#include "Parallel.h"
+
+namespace CubeMaker
+{
+
+/**
+ * Spreads the 10 low bits of the given value so that 2 zero bits separate
+ * each of them
+ */
+inline uint32_t spreadMortonBits(uint32_t value)
+{
+    value &= 0x000003ffu;
+    value = (value | (value << 16)) & 0x030000ffu;
+    value = (value | (value << 8)) & 0x0300f00fu;
+    value = (value | (value << 4)) & 0x030c30c3u;
+    value = (value | (value << 2)) & 0x09249249u;
+    return value;
+}
+
+/**
+ * Gathers every third bit of the given value, from the lowest one, the
+ * reverse of spreadMortonBits()
+ */
+inline uint32_t compactMortonBits(uint32_t value)
+{
+    value &= 0x09249249u;
+    value = (value | (value >> 2)) & 0x030c30c3u;
+    value = (value | (value >> 4)) & 0x0300f00fu;
+    value = (value | (value >> 8)) & 0x030000ffu;
+    value = (value | (value >> 16)) & 0x000003ffu;
+    return value;
+}
+
+/**
+ * Returns the Morton code interleaving the bits of the given cell
+ * coordinates, of up to 10 bits each, x being the lowest bit
+ */
+inline uint32_t getMortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return spreadMortonBits(x) | (spreadMortonBits(y) << 1) |
+        (spreadMortonBits(z) << 2);
+}
+
+/**
+ * Writes the cell coordinates encoded by the given Morton code into the
+ * given 3 values, see getMortonCode()
+ */
+inline void getMortonCoordinates(uint32_t code, uint32_t *coordinates)
+{
+    coordinates[0] = compactMortonBits(code);
+    coordinates[1] = compactMortonBits(code >> 1);
+    coordinates[2] = compactMortonBits(code >> 2);
+}
+
+/**
+ * Returns whether the two given bounding boxes, as { xmin, xmax, ymin,
+ * ymax, zmin, zmax }, intersect
+ */
+inline bool getBoundsIntersect(const double *a, const double *b)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (a[axis * 2] > b[axis * 2 + 1] || b[axis * 2] > a[axis * 2 + 1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * CubeGrid
+ *
+ * Uniform grid over the positions of a set of cubes at frame 0, with
+ * 2^depth cells along each axis, built in a single pass over the cubes.
+ *
+ * The cubes are sorted by cell, and the cells laid out in Morton order, so
+ * that the cells of any node of the matching octree, the 8^(depth - level)
+ * cells of a cube of 2^(depth - level) cells at some level, are contiguous:
+ * the cubes of a node, and their number, are found in constant time from
+ * the start offsets of its first and last cells. Each node also keeps the
+ * largest size of its cubes, so that its bound can be computed in constant
+ * time as well.
+ *
+ * Grids are immutable once built, and can be shared by concurrent cooks.
+ */
+class CubeGrid
+{
+public:
+
+    /**
+     * The largest depth, 2^21 cells, is picked for 2^24 cubes and more, so
+     * that there are at most 8 cubes per cell on average up to that number
+     */
+    static const int kMaxDepth = 7;
+
+    /**
+     * Smallest number of cubes placed in the grid by each task of the
+     * parallel loops
+     */
+    static const size_t kParallelGrainSize = 16384;
+
+    explicit CubeGrid(const Placement &placement)
+        : m_numberOfCubes(std::max(placement.numberOfCubes, 0)),
+          m_depth(0)
+    {
+        while (m_depth < kMaxDepth &&
+               (int64_t(1) << (3 * m_depth)) * 8 < m_numberOfCubes)
+        {
+            ++m_depth;
+        }
+        const uint32_t resolution = 1u << m_depth;
+        const size_t numberOfCells = size_t(1) << (3 * m_depth);
+
+        // The cells span the bound of the cubes at frame 0, slightly
+        // enlarged so that the last cells contain the farthest cubes
+        Placement restPlacement = placement;
+        restPlacement.time = 0.0;
+        double bound[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        if (m_numberOfCubes > 0)
+        {
+            getCubesBound(0, m_numberOfCubes, restPlacement, bound);
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double extent = bound[axis * 2 + 1] - bound[axis * 2];
+            m_origin[axis] = bound[axis * 2];
+            m_cellSize[axis] = extent > 0.0 ?
+                extent / resolution * (1.0 + 16.0 * DBL_EPSILON) : 1.0;
+            m_inverseCellSize[axis] = 1.0 / m_cellSize[axis];
+        }
+
+        // Find the cell of each cube in parallel, the positions being the
+        // costly part, then count the cubes of each cell, offsetting the
+        // counts by one so that they turn into the start offsets in place
+        std::vector<uint32_t> codes(m_numberOfCubes);
+        KatanaOps::parallelFor(0, codes.size(), kParallelGrainSize,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    double translate[3];
+                    getCubeRestTranslate(static_cast<int>(i), placement,
+                                         translate);
+                    uint32_t coordinates[3];
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        coordinates[axis] =
+                            getCellCoordinate(axis, translate[axis]);
+                    }
+                    codes[i] = getMortonCode(
+                        coordinates[0], coordinates[1], coordinates[2]);
+                }
+            });
+
+        m_cellStart.assign(numberOfCells + 1, 0);
+        m_maxHalfSizes.assign((numberOfCells * 8 - 1) / 7, 0.0);
+        double *leafHalfSizes = &m_maxHalfSizes[getLevelOffset(m_depth)];
+        for (int i = 0; i < m_numberOfCubes; ++i)
+        {
+            const uint32_t code = codes[i];
+            ++m_cellStart[code + 1];
+            leafHalfSizes[code] = std::max(leafHalfSizes[code],
+                0.5 * std::fabs(getCubeScale(i, placement)));
+        }
+        for (size_t cell = 0; cell < numberOfCells; ++cell)
+        {
+            m_cellStart[cell + 1] += m_cellStart[cell];
+        }
+
+        // Sort the cubes by cell, keeping them in index order in each cell
+        m_cubes.resize(m_numberOfCubes);
+        std::vector<int> offsets(m_cellStart.begin(), m_cellStart.end() - 1);
+        for (int i = 0; i < m_numberOfCubes; ++i)
+        {
+            m_cubes[offsets[codes[i]]++] = i;
+        }
+
+        // Each node is as large as the largest of its 8 children
+        for (int level = m_depth - 1; level >= 0; --level)
+        {
+            double *halfSizes = &m_maxHalfSizes[getLevelOffset(level)];
+            const double *childHalfSizes =
+                &m_maxHalfSizes[getLevelOffset(level + 1)];
+            const size_t numberOfNodes = size_t(1) << (3 * level);
+            for (size_t node = 0; node < numberOfNodes; ++node)
+            {
+                halfSizes[node] = *std::max_element(
+                    childHalfSizes + node * 8, childHalfSizes + node * 8 + 8);
+            }
+        }
+    }
+
+    int getNumberOfCubes() const { return m_numberOfCubes; }
+    int getDepth() const { return m_depth; }
+
+    /**
+     * Returns the number of cubes in the given node, of the given level from
+     * 0 (the whole grid) to getDepth() (a single cell)
+     */
+    int getNumberOfCubes(int level, uint32_t node) const
+    {
+        const int shift = 3 * (m_depth - level);
+        return m_cellStart[size_t(node + 1) << shift] -
+            m_cellStart[size_t(node) << shift];
+    }
+
+    /**
+     * Returns the indices of the cubes in the given node, in cell order,
+     * getNumberOfCubes(level, node) of them
+     */
+    const int* getCubes(int level, uint32_t node) const
+    {
+        return m_cubes.data() +
+            m_cellStart[size_t(node) << (3 * (m_depth - level))];
+    }
+
+    /**
+     * Writes the bounding box, as { xmin, xmax, ymin, ymax, zmin, zmax }, of
+     * the cubes in the given node, which must not be empty, once transformed
+     * by the given placement, the one the grid was built from at any time.
+     *
+     * This is computed in constant time from the extent of the node and the
+     * size of its largest cube, and is never larger than the bound of the
+     * whole set given by getCubesBound().
+     */
+    void getNodeBound(int level, uint32_t node, const Placement &placement,
+                      double bound[6]) const
+    {
+        const int shift = m_depth - level;
+        uint32_t coordinates[3];
+        getMortonCoordinates(node, coordinates);
+
+        const double halfSize =
+            m_maxHalfSizes[getLevelOffset(level) + node];
+        const double rotatedExtent = getMaxRotatedExtent(
+            getCubeRotation(0, placement),
+            getCubeRotation(m_numberOfCubes - 1, placement));
+        double wholeBound[6];
+        getCubesBound(0, m_numberOfCubes, placement, wholeBound);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double offset =
+                placement.translationSpeed[axis] * placement.time;
+            const double extent = axis == 0 ? 1.0 : rotatedExtent;
+            const double low = m_origin[axis] +
+                double(coordinates[axis] << shift) * m_cellSize[axis];
+            const double high = m_origin[axis] +
+                double((coordinates[axis] + 1) << shift) * m_cellSize[axis];
+            bound[axis * 2] = std::max(
+                low + offset - halfSize * extent, wholeBound[axis * 2]);
+            bound[axis * 2 + 1] = std::min(
+                high + offset + halfSize * extent, wholeBound[axis * 2 + 1]);
+        }
+    }
+
+    /**
+     * Appends the indices of the cubes in the given node whose bound, once
+     * transformed by the given placement, intersects the given region, to
+     * the given vector, skipping the nodes that don't intersect it
+     */
+    void getCubesInRegion(int level, uint32_t node, const Placement &placement,
+                          const double region[6],
+                          std::vector<int> &cubes) const
+    {
+        const int numberOfCubes = getNumberOfCubes(level, node);
+        if (numberOfCubes == 0)
+        {
+            return;
+        }
+        double bound[6];
+        getNodeBound(level, node, placement, bound);
+        if (!getBoundsIntersect(bound, region))
+        {
+            return;
+        }
+
+        if (level < m_depth)
+        {
+            for (uint32_t octant = 0; octant < 8; ++octant)
+            {
+                getCubesInRegion(level + 1, node * 8 + octant, placement,
+                                 region, cubes);
+            }
+            return;
+        }
+
+        // Within a cell, each cube is tested against its own bound
+        const int *nodeCubes = getCubes(level, node);
+        for (int i = 0; i < numberOfCubes; ++i)
+        {
+            const int index = nodeCubes[i];
+            double translate[3];
+            getCubeTranslate(index, placement, translate);
+            const double halfSize =
+                0.5 * std::fabs(getCubeScale(index, placement));
+            const double rotation =
+                getCubeRotation(index, placement) * g_degreesToRadians;
+            const double rotatedHalfSize = halfSize *
+                (std::fabs(std::cos(rotation)) + std::fabs(std::sin(rotation)));
+            double cubeBound[6];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const double extent = axis == 0 ? halfSize : rotatedHalfSize;
+                cubeBound[axis * 2] = translate[axis] - extent;
+                cubeBound[axis * 2 + 1] = translate[axis] + extent;
+            }
+            if (getBoundsIntersect(cubeBound, region))
+            {
+                cubes.push_back(index);
+            }
+        }
+    }
+
+private:
+
+    static size_t getLevelOffset(int level)
+    {
+        return ((size_t(1) << (3 * level)) - 1) / 7;
+    }
+
+    /**
+     * Returns the coordinate, along the given axis, of the cell holding the
+     * given position: the one whose extent, as computed by getNodeBound(),
+     * contains it
+     */
+    uint32_t getCellCoordinate(int axis, double position) const
+    {
+        const uint32_t last = (1u << m_depth) - 1;
+        // Truncating rounds the positive cells down, the error of the
+        // inverse being fixed below
+        const double cell =
+            (position - m_origin[axis]) * m_inverseCellSize[axis];
+        uint32_t coordinate = cell <= 0.0 ? 0 :
+            static_cast<uint32_t>(std::min(cell, double(last)));
+        while (coordinate > 0 &&
+               m_origin[axis] + double(coordinate) * m_cellSize[axis] >
+                   position)
+        {
+            --coordinate;
+        }
+        while (coordinate < last &&
+               m_origin[axis] + double(coordinate + 1) * m_cellSize[axis] <
+                   position)
+        {
+            ++coordinate;
+        }
+        return coordinate;
+    }
+
+    int m_numberOfCubes;
+    int m_depth;
+    double m_origin[3];
+    double m_cellSize[3];
+    double m_inverseCellSize[3];
+
+    // Start offset in m_cubes of each cell, in Morton order, and one past
+    // the end
+    std::vector<int> m_cellStart;
+    std::vector<int> m_cubes;
+
+    // Largest half size of the cubes of each node, level by level
+    std::vector<double> m_maxHalfSizes;
+};
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERGRID_H
@@ -0,0 +1,257 @@
+// Checks that the spatial grid of the CubeMaker Op is conservative.
+//
+// Builds CubeGrids over the line, box and sphere placements, still and
+// moving, and checks, against bounds computed from the 8 corners of each
+// cube, that every node bound contains the bounds of its cubes, and that
+// getCubesInRegion() returns exactly the cubes whose bound intersects the
+// region, for regions of all sizes. Run by ctest; exits with a non-zero
+// status if any check fails.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "CubeMakerGrid.h"
+#include "CubeMakerPlacement.h"
+
+namespace { //anonymous
+
+using CubeMaker::CubeGrid;
+using CubeMaker::Placement;
+
+// Slack allowed between bounds computed with different formulas, relative
+// to the magnitude of the coordinates
+const double kTolerance = 1e-9;
+
+int g_failures = 0;
+
+void fail(const std::string &test, const char *format, int a, int b)
+{
+    if (g_failures++ < 20)
+    {
+        std::fprintf(stderr, "FAILED: %s: ", test.c_str());
+        std::fprintf(stderr, format, a, b);
+        std::fprintf(stderr, "\n");
+    }
+}
+
+double getSlack(double value)
+{
+    return kTolerance * (1.0 + std::fabs(value));
+}
+
+/**
+ * Writes the bounding box of the 8 corners of the given cube, as
+ * transformed by the matrix of the given placement
+ */
+void getCornersBound(int index, const Placement &placement, double bound[6])
+{
+    double matrix[16];
+    CubeMaker::getCubeMatrix(index,
+                             CubeMaker::getCubeRotation(index, placement),
+                             placement, matrix);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        bound[axis * 2] = HUGE_VAL;
+        bound[axis * 2 + 1] = -HUGE_VAL;
+    }
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const double point[3] = { (corner & 1) ? 0.5 : -0.5,
+                                  (corner & 2) ? 0.5 : -0.5,
+                                  (corner & 4) ? 0.5 : -0.5 };
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // Row vectors, the translation on the last row
+            const double value = point[0] * matrix[axis] +
+                point[1] * matrix[4 + axis] + point[2] * matrix[8 + axis] +
+                matrix[12 + axis];
+            bound[axis * 2] = std::min(bound[axis * 2], value);
+            bound[axis * 2 + 1] = std::max(bound[axis * 2 + 1], value);
+        }
+    }
+}
+
+/**
+ * Returns whether the two given bounds intersect, the second one being
+ * enlarged, or shrunk, by the given number of tolerances
+ */
+bool getBoundsIntersect(const double *a, const double *b, double slack)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const double low = b[axis * 2] - slack * getSlack(b[axis * 2]);
+        const double high =
+            b[axis * 2 + 1] + slack * getSlack(b[axis * 2 + 1]);
+        if (a[axis * 2 + 1] < low || a[axis * 2] > high)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Simple deterministic generator of the test regions
+ */
+class Random
+{
+public:
+
+    explicit Random(uint64_t seed) : m_state(seed) {}
+
+    double next(double low, double high)
+    {
+        m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+        return low + (high - low) * double(m_state >> 11) * 0x1.0p-53;
+    }
+
+private:
+
+    uint64_t m_state;
+};
+
+/**
+ * Checks the grid over the given placement, the grid being built at frame
+ * 0 and queried at the time of the placement
+ */
+void checkPlacement(const std::string &test, const Placement &placement)
+{
+    Placement restPlacement = placement;
+    restPlacement.time = 0.0;
+    const CubeGrid grid(restPlacement);
+    const int numberOfCubes = grid.getNumberOfCubes();
+
+    std::vector<double> cubeBounds(static_cast<size_t>(numberOfCubes) * 6);
+    for (int i = 0; i < numberOfCubes; ++i)
+    {
+        getCornersBound(i, placement, &cubeBounds[static_cast<size_t>(i) * 6]);
+    }
+
+    // Every node bound contains the bounds of its cubes
+    for (int level = 0; level <= grid.getDepth(); ++level)
+    {
+        const uint32_t numberOfNodes = uint32_t(1) << (3 * level);
+        for (uint32_t node = 0; node < numberOfNodes; ++node)
+        {
+            const int count = grid.getNumberOfCubes(level, node);
+            if (count == 0)
+            {
+                continue;
+            }
+            double nodeBound[6];
+            grid.getNodeBound(level, node, placement, nodeBound);
+            const int *cubes = grid.getCubes(level, node);
+            for (int i = 0; i < count; ++i)
+            {
+                const double *cubeBound =
+                    &cubeBounds[static_cast<size_t>(cubes[i]) * 6];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    const double low = nodeBound[axis * 2];
+                    const double high = nodeBound[axis * 2 + 1];
+                    if (cubeBound[axis * 2] < low - getSlack(low) ||
+                        cubeBound[axis * 2 + 1] > high + getSlack(high))
+                    {
+                        fail(test, "cube %d outside of its node bound, "
+                             "level %d", cubes[i], level);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Region queries return the cubes intersecting the region, from a few
+    // cubes wide to the whole set
+    double wholeBound[6];
+    CubeMaker::getCubesBound(0, numberOfCubes, placement, wholeBound);
+    Random random(numberOfCubes);
+    size_t numberOfFound = 0;
+    for (int query = 0; query < 64; ++query)
+    {
+        const double fraction = std::pow(2.0, -(query % 8));
+        double region[6];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double low = wholeBound[axis * 2];
+            const double high = wholeBound[axis * 2 + 1];
+            const double size = (high - low) * fraction;
+            const double start = random.next(low - size * 0.5, high);
+            region[axis * 2] = start;
+            region[axis * 2 + 1] = start + size;
+        }
+
+        std::vector<int> cubes;
+        grid.getCubesInRegion(0, 0, placement, region, cubes);
+        numberOfFound += cubes.size();
+        std::vector<char> found(numberOfCubes, 0);
+        for (size_t i = 0; i < cubes.size(); ++i)
+        {
+            if (found[cubes[i]]++)
+            {
+                fail(test, "cube %d returned twice by query %d", cubes[i],
+                     query);
+            }
+        }
+        for (int i = 0; i < numberOfCubes; ++i)
+        {
+            const double *cubeBound = &cubeBounds[static_cast<size_t>(i) * 6];
+            // Cubes within the tolerance of the region may go either way
+            if (!found[i] && getBoundsIntersect(cubeBound, region, -1.0))
+            {
+                fail(test, "cube %d missed by query %d", i, query);
+            }
+            else if (found[i] && !getBoundsIntersect(cubeBound, region, 1.0))
+            {
+                fail(test, "cube %d wrongly returned by query %d", i,
+                     query);
+            }
+        }
+    }
+    if (numberOfFound == 0)
+    {
+        fail(test, "no cube returned by %d queries of %d cubes", 64,
+             numberOfCubes);
+    }
+}
+
+} // anonymous
+
+int main()
+{
+    const Placement::Mode modes[] = {
+        Placement::kModeLine, Placement::kModeBox, Placement::kModeSphere };
+    const char *const modeNames[] = { "line", "box", "sphere" };
+    for (int m = 0; m < 3; ++m)
+    {
+        Placement placement;
+        placement.mode = modes[m];
+        // The line grows quadratically, keep it of a sensible size
+        placement.numberOfCubes =
+            modes[m] == Placement::kModeLine ? 2000 : 20000;
+        placement.rotationStep = 90.0 / placement.numberOfCubes;
+        placement.seed = 7;
+        placement.scatterSize = 100.0;
+        placement.scatterScale = 0.5;
+        checkPlacement(std::string(modeNames[m]), placement);
+
+        placement.rotationSpeed = 30.0;
+        placement.translationSpeed[0] = 2.0;
+        placement.translationSpeed[1] = -1.5;
+        placement.translationSpeed[2] = 0.5;
+        placement.time = 2.5;
+        checkPlacement(std::string(modeNames[m]) + " moving", placement);
+    }
+
+    if (g_failures > 0)
+    {
+        std::fprintf(stderr, "%d checks failed.\n", g_failures);
+        return 1;
+    }
+    std::printf("Cube grid checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include "CubeMakerKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "CubeMakerKernelsIsa.h"
+
+namespace CubeMaker
+{
+
+namespace { //anonymous
+
+//------------------------------------------------------------------------------
+// Scalar kernels, handling all the placements
+
+void fillTransformsScalar(const Placement &placement, size_t begin,
+                          size_t end, double *translate, double *rotateX,
+                          double *rotateY, double *rotateZ, double *scale)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        const int index = static_cast<int>(i);
+        getCubeTranslate(index, placement, translate);
+
+        rotateX[0] = getCubeRotation(index, placement);
+        rotateX[1] = 1.0;
+        rotateX[2] = 0.0;
+        rotateX[3] = 0.0;
+
+        rotateY[0] = 0.0;
+        rotateY[1] = 0.0;
+        rotateY[2] = 1.0;
+        rotateY[3] = 0.0;
+
+        rotateZ[0] = 0.0;
+        rotateZ[1] = 0.0;
+        rotateZ[2] = 0.0;
+        rotateZ[3] = 1.0;
+
+        const double cubeScale = getCubeScale(index, placement);
+        scale[0] = cubeScale;
+        scale[1] = cubeScale;
+        scale[2] = cubeScale;
+
+        translate += 3;
+        rotateX += 4;
+        rotateY += 4;
+        rotateZ += 4;
+        scale += 3;
+    }
+}
+
+void fillMatricesScalar(const Placement &placement, size_t begin, size_t end,
+                        double *matrix)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        const int index = static_cast<int>(i);
+        getCubeMatrix(index, getCubeRotation(index, placement), placement,
+                      matrix);
+        matrix += 16;
+    }
+}
+
+#if defined(CUBEMAKER_KERNELS_X86)
+
+//------------------------------------------------------------------------------
+// Vectorized kernels, see CubeMakerKernelsIsa.h
+
+typedef size_t (*LineTransformsFunction)(
+    const LineKernelArgs &args, size_t begin, size_t end, double *translate,
+    double *rotateX, double *rotateY, double *rotateZ, double *scale);
+typedef size_t (*LineMatricesFunction)(
+    const LineKernelArgs &args, size_t begin, size_t end, double *matrix);
+
+/**
+ * Returns whether the cubes of the given placement are the ones the
+ * vectorized kernels handle, and sets their arguments if so
+ */
+bool getLineKernelArgs(const Placement &placement, LineKernelArgs &args)
+{
+    if (placement.mode != Placement::kModeLine ||
+        placement.hasTranslationMotion())
+    {
+        return false;
+    }
+    args.rotationStep = placement.rotationStep;
+    args.rotationOffset = placement.rotationSpeed * placement.time;
+    args.degreesToRadians = g_degreesToRadians;
+    return true;
+}
+
+template <LineTransformsFunction lineTransforms>
+void fillTransformsVector(const Placement &placement, size_t begin,
+                          size_t end, double *translate, double *rotateX,
+                          double *rotateY, double *rotateZ, double *scale)
+{
+    LineKernelArgs args;
+    size_t vectorEnd = begin;
+    if (getLineKernelArgs(placement, args))
+    {
+        vectorEnd = lineTransforms(args, begin, end, translate, rotateX,
+                                   rotateY, rotateZ, scale);
+    }
+    const size_t done = vectorEnd - begin;
+    fillTransformsScalar(placement, vectorEnd, end, translate + done * 3,
+                         rotateX + done * 4, rotateY + done * 4,
+                         rotateZ + done * 4, scale + done * 3);
+}
+
+template <LineMatricesFunction lineMatrices>
+void fillMatricesVector(const Placement &placement, size_t begin, size_t end,
+                        double *matrix)
+{
+    LineKernelArgs args;
+    size_t vectorEnd = begin;
+    if (getLineKernelArgs(placement, args))
+    {
+        vectorEnd = lineMatrices(args, begin, end, matrix);
+    }
+    fillMatricesScalar(placement, vectorEnd, end,
+                       matrix + (vectorEnd - begin) * 16);
+}
+
+#endif // CUBEMAKER_KERNELS_X86
+
+const InstanceKernels g_kernels[kNumKernelIsas] = {
+    { kKernelIsaScalar, "scalar", fillTransformsScalar, fillMatricesScalar },
+#if defined(CUBEMAKER_KERNELS_X86)
+    // The matrices are dominated by the trigonometry, which SSE2 doesn't
+    // help with
+    { kKernelIsaSse2, "sse2",
+      fillTransformsVector<fillLineTransformsSse2>, fillMatricesScalar },
+    { kKernelIsaAvx2, "avx2",
+      fillTransformsVector<fillLineTransformsAvx2>,
+      fillMatricesVector<fillLineMatricesAvx2> },
+#else
+    { kKernelIsaSse2, "sse2", fillTransformsScalar, fillMatricesScalar },
+    { kKernelIsaAvx2, "avx2", fillTransformsScalar, fillMatricesScalar },
+#endif
+};
+
+KernelIsa pickKernelIsa()
+{
+    int best = kKernelIsaScalar;
+    for (int isa = kKernelIsaScalar; isa < kNumKernelIsas; ++isa)
+    {
+        if (isKernelIsaSupported(static_cast<KernelIsa>(isa)))
+        {
+            best = isa;
+        }
+    }
+
+    if (const char *requested = std::getenv("KATANAOPS_KERNEL_ISA"))
+    {
+        for (int isa = kKernelIsaScalar; isa < best; ++isa)
+        {
+            if (std::strcmp(requested, g_kernels[isa].name) == 0)
+            {
+                best = isa;
+            }
+        }
+    }
+    return static_cast<KernelIsa>(best);
+}
+
+} // anonymous
+
+bool isKernelIsaSupported(KernelIsa isa)
+{
+    switch (isa)
+    {
+    case kKernelIsaScalar:
+        return true;
+#if defined(CUBEMAKER_KERNELS_X86)
+    case kKernelIsaSse2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case kKernelIsaAvx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+const InstanceKernels& getInstanceKernels(KernelIsa isa)
+{
+    return g_kernels[isa];
+}
+
+const InstanceKernels& getBestInstanceKernels()
+{
+    static const KernelIsa s_isa = pickKernelIsa();
+    return g_kernels[s_isa];
+}
+
+} // namespace CubeMaker
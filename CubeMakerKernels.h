@@ -0,0 +1,75 @@
+#ifndef KATANAOPS_CUBEMAKERKERNELS_H
+#define KATANAOPS_CUBEMAKERKERNELS_H
+
+#include <cstddef>
+
+#include "CubeMakerPlacement.h"
+
+namespace CubeMaker
+{
+
+/**
+ * Instruction sets the instance kernels are available for
+ */
+enum KernelIsa
+{
+    kKernelIsaScalar = 0,
+    kKernelIsaSse2,
+    kKernelIsaAvx2,
+    kNumKernelIsas
+};
+
+/**
+ * InstanceKernels
+ *
+ * Batch kernels writing the transforms of the instances in [begin, end)
+ * straight into contiguous buffers, laid out as the corresponding instance
+ * array attributes, the buffers pointing at the values of instance 'begin':
+ *
+ * - fillTransforms() writes 3 translate, 4 rotateX, 4 rotateY, 4 rotateZ and
+ *   3 scale values per instance.
+ * - fillMatrices() writes the 16 values of the row-major matrix of each
+ *   instance.
+ *
+ * The vectorized kernels handle the line placement, the scatter placements
+ * are computed one instance at a time, as they are dominated by the random
+ * number generation and trigonometry, as are the moving cubes. All the
+ * kernels produce the same values as the functions of CubeMakerPlacement.h.
+ */
+struct InstanceKernels
+{
+    typedef void (*FillTransformsFunction)(
+        const Placement &placement, size_t begin, size_t end,
+        double *translate, double *rotateX, double *rotateY, double *rotateZ,
+        double *scale);
+    typedef void (*FillMatricesFunction)(
+        const Placement &placement, size_t begin, size_t end, double *matrix);
+
+    KernelIsa isa;
+    const char *name;
+    FillTransformsFunction fillTransforms;
+    FillMatricesFunction fillMatrices;
+};
+
+/**
+ * Returns whether the kernels for the given instruction set are compiled in
+ * and supported by the running CPU
+ */
+bool isKernelIsaSupported(KernelIsa isa);
+
+/**
+ * Returns the kernels for the given instruction set, which must be
+ * supported
+ */
+const InstanceKernels& getInstanceKernels(KernelIsa isa);
+
+/**
+ * Returns the kernels for the best instruction set supported by the running
+ * CPU, picked once. The KATANAOPS_KERNEL_ISA environment variable ('scalar',
+ * 'sse2' or 'avx2') can be used to request a lower one.
+ */
+const InstanceKernels& getBestInstanceKernels();
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERKERNELS_H
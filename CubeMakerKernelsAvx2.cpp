@@ -0,0 +1,146 @@
+#include "CubeMakerKernelsIsa.h"
+
+#if defined(CUBEMAKER_KERNELS_X86)
+
+#if !defined(__AVX2__)
+#error "CubeMakerKernelsAvx2.cpp must be compiled for AVX2, see CMakeLists.txt"
+#endif
+
+// The C library only, std::cos() and std::sin() could bring in inline
+// overloads, see CubeMakerKernelsIsa.h
+#include <immintrin.h>
+#include <math.h>
+
+namespace CubeMaker
+{
+
+//------------------------------------------------------------------------------
+// AVX2 kernels, four instances at a time
+
+size_t fillLineTransformsAvx2(const LineKernelArgs &args, size_t begin,
+                              size_t end, double *translate, double *rotateX,
+                              double *rotateY, double *rotateZ, double *scale)
+{
+    const size_t vectorEnd = begin + (end - begin) / 4 * 4;
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d quarter = _mm256_set1_pd(0.25);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d rotationStep = _mm256_set1_pd(args.rotationStep);
+    const __m256d rotationOffset = _mm256_set1_pd(args.rotationOffset);
+    const __m256d rotateAxisX = _mm256_set_pd(0.0, 0.0, 1.0, 0.0);
+    const __m256d rotateAxisY = _mm256_set_pd(0.0, 1.0, 0.0, 0.0);
+    const __m256d rotateAxisZ = _mm256_set_pd(1.0, 0.0, 0.0, 0.0);
+
+    const double first = static_cast<double>(begin);
+    __m256d indices = _mm256_set_pd(first + 3.0, first + 2.0, first + 1.0,
+                                    first);
+    for (size_t i = begin; i < vectorEnd; i += 4)
+    {
+        const __m256d tx = _mm256_mul_pd(
+            _mm256_mul_pd(quarter, _mm256_add_pd(indices, two)), indices);
+        const __m256d rx = _mm256_add_pd(
+            _mm256_mul_pd(rotationStep, indices), rotationOffset);
+        const __m256d s = _mm256_mul_pd(_mm256_add_pd(indices, one), half);
+
+        // { tx0, 0, 0, tx1 | 0, 0, tx2, 0 | 0, tx3, 0, 0 }
+        _mm256_storeu_pd(translate, _mm256_blend_pd(
+            zero, _mm256_permute4x64_pd(tx, 0x40), 0x9));
+        _mm256_storeu_pd(translate + 4, _mm256_blend_pd(
+            zero, _mm256_permute4x64_pd(tx, 0xA0), 0x4));
+        _mm256_storeu_pd(translate + 8, _mm256_blend_pd(
+            zero, _mm256_permute4x64_pd(tx, 0x0C), 0x2));
+
+        // { rxk, 1, 0, 0 } for each of the four instances
+        _mm256_storeu_pd(rotateX, _mm256_blend_pd(
+            rotateAxisX, _mm256_permute4x64_pd(rx, 0x00), 0x1));
+        _mm256_storeu_pd(rotateX + 4, _mm256_blend_pd(
+            rotateAxisX, _mm256_permute4x64_pd(rx, 0x55), 0x1));
+        _mm256_storeu_pd(rotateX + 8, _mm256_blend_pd(
+            rotateAxisX, _mm256_permute4x64_pd(rx, 0xAA), 0x1));
+        _mm256_storeu_pd(rotateX + 12, _mm256_blend_pd(
+            rotateAxisX, _mm256_permute4x64_pd(rx, 0xFF), 0x1));
+
+        for (int k = 0; k < 16; k += 4)
+        {
+            _mm256_storeu_pd(rotateY + k, rotateAxisY);
+            _mm256_storeu_pd(rotateZ + k, rotateAxisZ);
+        }
+
+        // { s0, s0, s0, s1 | s1, s1, s2, s2 | s2, s3, s3, s3 }
+        _mm256_storeu_pd(scale, _mm256_permute4x64_pd(s, 0x40));
+        _mm256_storeu_pd(scale + 4, _mm256_permute4x64_pd(s, 0xA5));
+        _mm256_storeu_pd(scale + 8, _mm256_permute4x64_pd(s, 0xFE));
+
+        indices = _mm256_add_pd(indices, four);
+        translate += 12;
+        rotateX += 16;
+        rotateY += 16;
+        rotateZ += 16;
+        scale += 12;
+    }
+
+    return vectorEnd;
+}
+
+size_t fillLineMatricesAvx2(const LineKernelArgs &args, size_t begin,
+                            size_t end, double *matrix)
+{
+    const size_t vectorEnd = begin + (end - begin) / 4 * 4;
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d quarter = _mm256_set1_pd(0.25);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d rotationStep = _mm256_set1_pd(args.rotationStep);
+    const __m256d rotationOffset = _mm256_set1_pd(args.rotationOffset);
+    const __m256d degreesToRadians = _mm256_set1_pd(args.degreesToRadians);
+
+    const double first = static_cast<double>(begin);
+    __m256d indices = _mm256_set_pd(first + 3.0, first + 2.0, first + 1.0,
+                                    first);
+    double tx[4], s[4], radians[4];
+    for (size_t i = begin; i < vectorEnd; i += 4)
+    {
+        _mm256_storeu_pd(tx, _mm256_mul_pd(
+            _mm256_mul_pd(quarter, _mm256_add_pd(indices, two)), indices));
+        _mm256_storeu_pd(s, _mm256_mul_pd(_mm256_add_pd(indices, one), half));
+        _mm256_storeu_pd(radians, _mm256_mul_pd(
+            _mm256_add_pd(_mm256_mul_pd(rotationStep, indices),
+                          rotationOffset),
+            degreesToRadians));
+
+        for (int k = 0; k < 4; ++k)
+        {
+            // There is no vector trigonometry in the intrinsics, and the
+            // angle is a constant 0 unless cubes are rotated
+            double cosine = 1.0;
+            double sine = 0.0;
+            if (radians[k] != 0.0)
+            {
+                cosine = cos(radians[k]);
+                sine = sin(radians[k]);
+            }
+            const double c = cosine * s[k];
+            const double sn = sine * s[k];
+
+            _mm256_storeu_pd(matrix, _mm256_set_pd(0.0, 0.0, 0.0, s[k]));
+            _mm256_storeu_pd(matrix + 4, _mm256_set_pd(0.0, sn, c, 0.0));
+            _mm256_storeu_pd(matrix + 8, _mm256_set_pd(0.0, c, -sn, 0.0));
+            _mm256_storeu_pd(matrix + 12, _mm256_set_pd(1.0, 0.0, 0.0, tx[k]));
+            matrix += 16;
+        }
+
+        indices = _mm256_add_pd(indices, four);
+    }
+
+    return vectorEnd;
+}
+
+} // namespace CubeMaker
+
+#endif // CUBEMAKER_KERNELS_X86
@@ -0,0 +1,58 @@
+#ifndef KATANAOPS_CUBEMAKERKERNELSISA_H
+#define KATANAOPS_CUBEMAKERKERNELSISA_H
+
+#include <cstddef>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CUBEMAKER_KERNELS_X86 1
+#endif
+
+namespace CubeMaker
+{
+
+/**
+ * Interface between CubeMakerKernels.cpp and the translation units holding
+ * the vectorized kernels, one per instruction set, which are compiled with
+ * the flags of that instruction set (see CMakeLists.txt).
+ *
+ * Those translation units only include this header, the intrinsics and the
+ * C library: an inline function of any other header, compiled there for
+ * the instruction set and picked by the linker over its baseline copy, would
+ * otherwise end up called on CPUs lacking it. As a result, the kernels only
+ * handle the line placement of still cubes, given by value, up to a whole
+ * number of vectors, CubeMakerKernels.cpp dealing with everything else.
+ */
+struct LineKernelArgs
+{
+    double rotationStep;
+    /// Rotation added to all the cubes, in degrees
+    double rotationOffset;
+    double degreesToRadians;
+};
+
+/**
+ * Write the transforms, as InstanceKernels::fillTransforms(), of the line
+ * placed instances from 'begin', a whole number of vectors of them, up to
+ * 'end' at most, and return the index of the first instance left
+ */
+size_t fillLineTransformsSse2(const LineKernelArgs &args, size_t begin,
+                              size_t end, double *translate, double *rotateX,
+                              double *rotateY, double *rotateZ,
+                              double *scale);
+size_t fillLineTransformsAvx2(const LineKernelArgs &args, size_t begin,
+                              size_t end, double *translate, double *rotateX,
+                              double *rotateY, double *rotateZ,
+                              double *scale);
+
+/**
+ * Write the matrices, as InstanceKernels::fillMatrices(), of the line placed
+ * instances from 'begin', a whole number of vectors of them, up to 'end' at
+ * most, and return the index of the first instance left
+ */
+size_t fillLineMatricesAvx2(const LineKernelArgs &args, size_t begin,
+                            size_t end, double *matrix);
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERKERNELSISA_H
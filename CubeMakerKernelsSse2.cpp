@@ -0,0 +1,84 @@
+#include "CubeMakerKernelsIsa.h"
+
+#if defined(CUBEMAKER_KERNELS_X86)
+
+#if !defined(__SSE2__)
+#error "CubeMakerKernelsSse2.cpp must be compiled for SSE2, see CMakeLists.txt"
+#endif
+
+#include <immintrin.h>
+
+namespace CubeMaker
+{
+
+//------------------------------------------------------------------------------
+// SSE2 kernels, two instances at a time
+
+size_t fillLineTransformsSse2(const LineKernelArgs &args, size_t begin,
+                              size_t end, double *translate, double *rotateX,
+                              double *rotateY, double *rotateZ, double *scale)
+{
+    const size_t vectorEnd = begin + (end - begin) / 2 * 2;
+
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d quarter = _mm_set1_pd(0.25);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d rotationStep = _mm_set1_pd(args.rotationStep);
+    const __m128d rotationOffset = _mm_set1_pd(args.rotationOffset);
+    // { 1, 0 } and { 0, 1 }, _mm_set_pd() taking the high value first
+    const __m128d unitLow = _mm_set_pd(0.0, 1.0);
+    const __m128d unitHigh = _mm_set_pd(1.0, 0.0);
+
+    __m128d indices = _mm_set_pd(static_cast<double>(begin + 1),
+                                 static_cast<double>(begin));
+    for (size_t i = begin; i < vectorEnd; i += 2)
+    {
+        const __m128d tx = _mm_mul_pd(
+            _mm_mul_pd(quarter, _mm_add_pd(indices, two)), indices);
+        const __m128d rx = _mm_add_pd(_mm_mul_pd(rotationStep, indices),
+                                      rotationOffset);
+        const __m128d s = _mm_mul_pd(_mm_add_pd(indices, one), half);
+
+        // { tx0, 0, 0, tx1, 0, 0 }
+        _mm_storeu_pd(translate, _mm_move_sd(zero, tx));
+        _mm_storeu_pd(translate + 2, _mm_unpackhi_pd(zero, tx));
+        _mm_storeu_pd(translate + 4, zero);
+
+        // { rx0, 1, 0, 0, rx1, 1, 0, 0 }
+        _mm_storeu_pd(rotateX, _mm_unpacklo_pd(rx, one));
+        _mm_storeu_pd(rotateX + 2, zero);
+        _mm_storeu_pd(rotateX + 4, _mm_unpackhi_pd(rx, one));
+        _mm_storeu_pd(rotateX + 6, zero);
+
+        // { 0, 0, 1, 0 } and { 0, 0, 0, 1 } for both instances
+        _mm_storeu_pd(rotateY, zero);
+        _mm_storeu_pd(rotateY + 2, unitLow);
+        _mm_storeu_pd(rotateY + 4, zero);
+        _mm_storeu_pd(rotateY + 6, unitLow);
+
+        _mm_storeu_pd(rotateZ, zero);
+        _mm_storeu_pd(rotateZ + 2, unitHigh);
+        _mm_storeu_pd(rotateZ + 4, zero);
+        _mm_storeu_pd(rotateZ + 6, unitHigh);
+
+        // { s0, s0, s0, s1, s1, s1 }
+        _mm_storeu_pd(scale, _mm_unpacklo_pd(s, s));
+        _mm_storeu_pd(scale + 2, s);
+        _mm_storeu_pd(scale + 4, _mm_unpackhi_pd(s, s));
+
+        indices = _mm_add_pd(indices, two);
+        translate += 6;
+        rotateX += 8;
+        rotateY += 8;
+        rotateZ += 8;
+        scale += 6;
+    }
+
+    return vectorEnd;
+}
+
+} // namespace CubeMaker
+
+#endif // CUBEMAKER_KERNELS_X86
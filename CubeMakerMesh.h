@@ -0,0 +1,153 @@
+#ifndef KATANAOPS_CUBEMAKERMESH_H
+#define KATANAOPS_CUBEMAKERMESH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "CubeMakerPlacement.h"
+#include "CubeMakerTopology.h"
+
+namespace CubeMaker
+{
+
+/**
+ * MeshDetail
+ *
+ * Describes the tessellation of the cube meshes and how it decreases with
+ * the distance of the cubes, so that far away cubes are given cheaper
+ * meshes.
+ *
+ * Level L meshes have 2^L quads along each edge of the cube, level 0 being
+ * the plain 6 quads cube. Like CubeMakerPlacement.h, this header only
+ * depends on the standard library.
+ */
+struct MeshDetail
+{
+    enum { kMaxSubdivisions = 6 };
+
+    MeshDetail() : subdivisions(0), roundness(0.0), lodDistance(0.0)
+    {
+        lodCenter[0] = lodCenter[1] = lodCenter[2] = 0.0;
+    }
+
+    /**
+     * Returns the number of distinct levels the cubes can be given
+     */
+    int getNumberOfLevels() const
+    {
+        return lodDistance > 0.0 ? subdivisions + 1 : 1;
+    }
+
+    /// Level of the cubes closest to the LOD center
+    int subdivisions;
+    /// Radius of the rounded edges and corners, relative to half the cube
+    /// size, from 0 (sharp) to 1 (sphere)
+    double roundness;
+    /// Distance from the LOD center over which cubes lose one level, 0 to
+    /// give all cubes the same level
+    double lodDistance;
+    double lodCenter[3];
+};
+
+/**
+ * Returns the level of the mesh of the i-th cube: the number of
+ * subdivisions, less one for each LOD distance between the cube and the LOD
+ * center
+ */
+inline int getCubeLevel(int index, const Placement &placement,
+                        const MeshDetail &detail)
+{
+    if (detail.lodDistance <= 0.0 || detail.subdivisions == 0)
+    {
+        return detail.subdivisions;
+    }
+
+    double translate[3];
+    getCubeTranslate(index, placement, translate);
+    const double dx = translate[0] - detail.lodCenter[0];
+    const double dy = translate[1] - detail.lodCenter[1];
+    const double dz = translate[2] - detail.lodCenter[2];
+    const double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+    const double levelsLost = std::floor(distance / detail.lodDistance);
+    if (levelsLost >= detail.subdivisions)
+    {
+        return 0;
+    }
+    return detail.subdivisions - static_cast<int>(levelsLost);
+}
+
+/**
+ * Returns the number of points and faces of the cube mesh of the given level
+ */
+inline void getMeshSizes(int level, int64_t &numPoints, int64_t &numFaces)
+{
+    numPoints = topology::getNumPoints(level);
+    numFaces = topology::getNumFaces(level);
+}
+
+/**
+ * Writes the cube mesh of the given level, with the given roundness, into
+ * 'points' (3 values per point), 'vertexList' (4 values per face) and
+ * 'startIndex' (1 value per face plus 1), sized as given by getMeshSizes().
+ *
+ * This evaluates the formulas of CubeMakerTopology.h at runtime, giving the
+ * same values as the compile-time tables of the sharp meshes.
+ */
+inline void buildMesh(int level, double roundness, float *points,
+                      int *vertexList, int *startIndex)
+{
+    const int numPoints = topology::getNumPoints(level);
+    const int numFaces = topology::getNumFaces(level);
+    const int numVertices = topology::getNumVertices(level);
+
+    const double radius = 0.5 * std::min(std::max(roundness, 0.0), 1.0);
+    const double innerHalfSize = 0.5 - radius;
+    for (int i = 0; i < numPoints; ++i)
+    {
+        float *point = points + static_cast<size_t>(i) * 3;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            point[axis] = topology::getPointCoordinate(level, i, axis);
+        }
+        if (radius <= 0.0)
+        {
+            continue;
+        }
+
+        // Push the point out from the nearest point of the inner box, at
+        // the rounding radius
+        double inner[3], offset[3];
+        double length = 0.0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            inner[axis] = std::min(std::max<double>(point[axis],
+                                                    -innerHalfSize),
+                                   innerHalfSize);
+            offset[axis] = point[axis] - inner[axis];
+            length += offset[axis] * offset[axis];
+        }
+        length = std::sqrt(length);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            point[axis] = static_cast<float>(
+                inner[axis] +
+                (length > 0.0 ? offset[axis] * radius / length : 0.0));
+        }
+    }
+
+    for (int i = 0; i < numVertices; ++i)
+    {
+        vertexList[i] = topology::getVertex(level, i);
+    }
+    for (int i = 0; i <= numFaces; ++i)
+    {
+        startIndex[i] = topology::getStartIndex(i);
+    }
+}
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERMESH_H
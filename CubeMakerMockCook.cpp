@@ -0,0 +1,496 @@
+// Mock-cook harness for the CubeMaker Op.
+//
+// Expands the whole scene generated by a CubeMaker Op, from /root down to
+// the cube leaves, and reports the number of locations cooked per second,
+// the peak resident memory and, for each depth of the scene graph, the
+// number of locations and the time spent cooking them. Meant for repeatable
+// scale tests of the Op's own cook code:
+//
+//     CubeMakerMockCook --cubes 100000000 --bucket-size 1000 --threads 64
+//
+// The Op is compiled into the harness, from CubeMakerOp.h, and cooked
+// through MockCookInterface (see MockCookInterface.h), on a pool of threads
+// expanding the scene depth first, each one cooking a location at a time.
+// This is not a Geolib3 runtime: the built plug-in DSOs (CubeMaker.so, with
+// its LTO and PGO, and HelloWorldOp.so) aren't loaded, and Geolib's
+// scheduling, Op argument hashing, caching and attribute transfer aren't
+// involved, so its figures only bound the cost of the cooks themselves and
+// aren't representative of a farm render. It only needs the FnAttribute
+// library, no Katana session or license.
+//
+// The cooks can also run their own parallel loops, see Parallel.h, whose
+// threads are limited by KATANAOPS_THREADS.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <FnAttribute/FnAttribute.h>
+#include <FnAttribute/FnGroupBuilder.h>
+
+#include "CubeMakerOp.h"
+#include "MockCookInterface.h"
+
+namespace { //anonymous
+
+using KatanaOps::MockCookInterface;
+
+struct Options
+{
+    std::string location;
+    int numberOfCubes;
+    int bucketSize;
+    std::string outputMode;
+    std::string placement;
+    double scatterSize;
+    bool spatialBuckets;
+    unsigned numberOfThreads;
+
+    Options()
+        : location("/root/world/geo/cubeMaker"),
+          numberOfCubes(1000),
+          bucketSize(1000),
+          outputMode("locations"),
+          placement("line"),
+          scatterSize(10.0),
+          spatialBuckets(false),
+          numberOfThreads(std::max(std::thread::hardware_concurrency(), 1u))
+    {
+    }
+};
+
+void printUsage(const char *program)
+{
+    std::printf(
+        "Usage: %s [options]\n"
+        "  --cubes N          number of cubes (default 1000)\n"
+        "  --bucket-size N    maximum children per location, 0 to disable\n"
+        "                     bucketing (default 1000)\n"
+        "  --output-mode M    'locations' (default) or 'instanceArray'\n"
+        "  --placement P      'line' (default), 'box' or 'sphere'\n"
+        "  --scatter-size S   edge of the scatter placements (default 10)\n"
+        "  --spatial          form the bucket groups spatially\n"
+        "  --location PATH    base location of the cubes\n"
+        "                     (default /root/world/geo/cubeMaker)\n"
+        "  --threads N        number of cooking threads (default: one per\n"
+        "                     hardware thread)\n",
+        program);
+}
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (option == "--spatial")
+        {
+            options.spatialBuckets = true;
+            continue;
+        }
+        if (!value)
+        {
+            std::fprintf(stderr, "Missing value for '%s'.\n", option.c_str());
+            return false;
+        }
+        ++i;
+        if (option == "--cubes")
+        {
+            options.numberOfCubes = std::atoi(value);
+        }
+        else if (option == "--bucket-size")
+        {
+            options.bucketSize = std::atoi(value);
+        }
+        else if (option == "--output-mode")
+        {
+            options.outputMode = value;
+        }
+        else if (option == "--placement")
+        {
+            options.placement = value;
+        }
+        else if (option == "--scatter-size")
+        {
+            options.scatterSize = std::atof(value);
+        }
+        else if (option == "--location")
+        {
+            options.location = value;
+        }
+        else if (option == "--threads")
+        {
+            options.numberOfThreads =
+                static_cast<unsigned>(std::max(std::atoi(value), 1));
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown option '%s'.\n", option.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the Op arguments the CubeMaker node would build for the given
+ * options
+ */
+FnAttribute::GroupAttribute buildOpArgs(const Options &options)
+{
+    FnAttribute::GroupBuilder gb;
+    gb.set("location", FnAttribute::StringAttribute(options.location));
+    gb.set("a.numberOfCubes", FnAttribute::IntAttribute(options.numberOfCubes));
+    gb.set("a.bucketSize", FnAttribute::IntAttribute(options.bucketSize));
+    gb.set("a.outputMode", FnAttribute::StringAttribute(options.outputMode));
+    gb.set("a.placement", FnAttribute::StringAttribute(options.placement));
+    if (options.placement != "line")
+    {
+        gb.set("a.scatterSize",
+               FnAttribute::DoubleAttribute(options.scatterSize));
+    }
+    if (options.spatialBuckets)
+    {
+        gb.set("a.spatialBuckets", FnAttribute::IntAttribute(1));
+    }
+    return gb.build();
+}
+
+/**
+ * Returns the peak resident memory of the process, in bytes
+ */
+size_t getPeakResidentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                                sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/**
+ * Number of locations cooked at a given depth, and the time spent on them
+ */
+struct DepthStats
+{
+    unsigned long long locations;
+    unsigned long long cookTime;
+    unsigned long long errors;
+
+    DepthStats() : locations(0), cookTime(0), errors(0) {}
+};
+
+/**
+ * Location waiting to be cooked, with the arguments and private data given
+ * by its parent
+ */
+struct Task
+{
+    std::string path;
+    int depth;
+    MockCookInterface::Child child;
+};
+
+/**
+ * Traversal
+ *
+ * Cooks a scene graph depth first on a pool of threads. Each thread keeps
+ * the locations it creates on its own stack, and only shares them when
+ * other threads run out of work, so that the threads seldom synchronize.
+ */
+class Traversal
+{
+public:
+
+    explicit Traversal(unsigned numberOfThreads)
+        : m_numberOfThreads(numberOfThreads),
+          m_pendingTasks(0),
+          m_idleThreads(0),
+          m_done(false),
+          m_threadStats(numberOfThreads)
+    {
+    }
+
+    /**
+     * Cooks the given location, and all the locations below it, and
+     * returns the statistics of each depth
+     */
+    std::vector<DepthStats> run(const std::string &path,
+                                const FnAttribute::GroupAttribute &opArgs)
+    {
+        Task root;
+        root.path = path;
+        root.depth = 0;
+        root.child.args = opArgs;
+        root.child.privateData = nullptr;
+        root.child.deletePrivateData = nullptr;
+        m_sharedTasks.push_back(root);
+        m_pendingTasks = 1;
+
+        std::vector<std::thread> threads;
+        for (unsigned thread = 0; thread < m_numberOfThreads; ++thread)
+        {
+            threads.emplace_back(&Traversal::work, this, thread);
+        }
+        for (size_t thread = 0; thread < threads.size(); ++thread)
+        {
+            threads[thread].join();
+        }
+
+        std::vector<DepthStats> stats;
+        for (size_t thread = 0; thread < m_threadStats.size(); ++thread)
+        {
+            const std::vector<DepthStats> &threadStats =
+                m_threadStats[thread];
+            stats.resize(std::max(stats.size(), threadStats.size()));
+            for (size_t depth = 0; depth < threadStats.size(); ++depth)
+            {
+                stats[depth].locations += threadStats[depth].locations;
+                stats[depth].cookTime += threadStats[depth].cookTime;
+                stats[depth].errors += threadStats[depth].errors;
+            }
+        }
+        return stats;
+    }
+
+    const std::string& getFirstError() const { return m_firstError; }
+
+private:
+
+    void work(unsigned thread)
+    {
+        std::vector<DepthStats> &stats = m_threadStats[thread];
+        std::vector<Task> tasks;
+        std::vector<MockCookInterface::Child> children;
+        Task task;
+        while (popTask(tasks, task))
+        {
+            const std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            MockCookInterface interface(task.child.args, task.path,
+                                        task.child.privateData, true);
+            CubeMaker::CubeMakerOp::cookLocation(interface);
+            const std::chrono::steady_clock::time_point end =
+                std::chrono::steady_clock::now();
+
+            // The location owns its private data once cooked
+            if (task.child.deletePrivateData)
+            {
+                task.child.deletePrivateData(task.child.privateData);
+            }
+
+            if (stats.size() <= static_cast<size_t>(task.depth))
+            {
+                stats.resize(task.depth + 1);
+            }
+            DepthStats &depthStats = stats[task.depth];
+            ++depthStats.locations;
+            depthStats.cookTime += static_cast<unsigned long long>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    end - start).count());
+            if (!interface.getErrorMessage().empty())
+            {
+                ++depthStats.errors;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_firstError.empty())
+                {
+                    m_firstError =
+                        task.path + ": " + interface.getErrorMessage();
+                }
+            }
+
+            // Push the children in reverse, so that they are cooked in
+            // order
+            children.clear();
+            interface.takeChildren(children);
+            m_pendingTasks += children.size();
+            for (size_t i = children.size(); i > 0; --i)
+            {
+                Task childTask;
+                childTask.path = task.path + "/" + children[i - 1].name;
+                childTask.depth = task.depth + 1;
+                childTask.child = children[i - 1];
+                tasks.push_back(childTask);
+            }
+            shareTasks(tasks);
+
+            if (--m_pendingTasks == 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done = true;
+                m_condition.notify_all();
+            }
+        }
+    }
+
+    /**
+     * Pops the next task from the given local stack or, when empty, from the
+     * shared one, waiting for other threads to share some, and returns
+     * false once the whole scene graph has been cooked
+     */
+    bool popTask(std::vector<Task> &tasks, Task &task)
+    {
+        if (!tasks.empty())
+        {
+            task = tasks.back();
+            tasks.pop_back();
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_idleThreads;
+        m_condition.wait(lock, [this]()
+        {
+            return m_done || !m_sharedTasks.empty();
+        });
+        --m_idleThreads;
+        if (m_sharedTasks.empty())
+        {
+            return false;
+        }
+        task = m_sharedTasks.back();
+        m_sharedTasks.pop_back();
+        return true;
+    }
+
+    /**
+     * Moves the bottom half of the given local stack, the locations closest
+     * to the root and so the largest subtrees, to the shared stack when
+     * other threads are waiting for work
+     */
+    void shareTasks(std::vector<Task> &tasks)
+    {
+        if (tasks.size() < 2 || m_idleThreads.load() == 0)
+        {
+            return;
+        }
+        const size_t count = tasks.size() / 2;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sharedTasks.insert(m_sharedTasks.end(), tasks.begin(),
+                             tasks.begin() + count);
+        tasks.erase(tasks.begin(), tasks.begin() + count);
+        m_condition.notify_all();
+    }
+
+    const unsigned m_numberOfThreads;
+    std::atomic<size_t> m_pendingTasks;
+    std::atomic<unsigned> m_idleThreads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<Task> m_sharedTasks;
+    bool m_done;
+    std::string m_firstError;
+
+    std::vector<std::vector<DepthStats> > m_threadStats;
+};
+
+} // anonymous
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--help") == 0 ||
+            std::strcmp(argv[i], "-h") == 0)
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+    }
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The FnAttribute library needs to be bootstrapped when used outside
+    // of a Katana process
+    const char *katanaRoot = std::getenv("KATANA_ROOT");
+    if (!FnAttribute::Bootstrap(katanaRoot ? katanaRoot
+                                           : CUBEMAKER_MOCKCOOK_KATANA_ROOT))
+    {
+        std::fprintf(stderr, "Cannot bootstrap the FnAttribute library.\n");
+        return 1;
+    }
+
+    const FnAttribute::GroupAttribute opArgs = buildOpArgs(options);
+    Traversal traversal(options.numberOfThreads);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    const std::vector<DepthStats> stats = traversal.run("/root", opArgs);
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    unsigned long long locations = 0;
+    unsigned long long errors = 0;
+    for (size_t depth = 0; depth < stats.size(); ++depth)
+    {
+        locations += stats[depth].locations;
+        errors += stats[depth].errors;
+    }
+
+    std::printf("cubes: %d, bucket size: %d, output mode: %s, "
+                "placement: %s%s, threads: %u\n",
+                options.numberOfCubes, options.bucketSize,
+                options.outputMode.c_str(), options.placement.c_str(),
+                options.spatialBuckets ? " (spatial buckets)" : "",
+                options.numberOfThreads);
+    std::printf("locations: %llu in %.3f s (%.0f locations/s)\n", locations,
+                seconds, seconds > 0.0 ? locations / seconds : 0.0);
+    std::printf("peak resident memory: %.1f MB\n",
+                getPeakResidentMemory() / (1024.0 * 1024.0));
+    std::printf("\n%5s %12s %12s %12s\n", "depth", "locations", "cook ms",
+                "us/location");
+    for (size_t depth = 0; depth < stats.size(); ++depth)
+    {
+        const double milliseconds = stats[depth].cookTime * 1e-6;
+        std::printf("%5zu %12llu %12.3f %12.3f\n", depth,
+                    stats[depth].locations, milliseconds,
+                    stats[depth].locations ?
+                        milliseconds * 1e3 / stats[depth].locations : 0.0);
+    }
+
+    if (errors > 0)
+    {
+        std::fflush(stdout);
+        std::fprintf(stderr, "\n%llu locations failed to cook, first: %s\n",
+                     errors, traversal.getFirstError().c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,2370 @@
+#ifndef KATANAOPS_CUBEMAKEROP_H
+#define KATANAOPS_CUBEMAKEROP_H
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+#include <FnAttribute/FnGroupBuilder.h>
+
+#include <FnGeolib/op/FnGeolibOp.h>
+
+#include "Arena.h"
+#include "AttributeCache.h"
+#include "CubeMakerGrid.h"
+#include "CubeMakerKernels.h"
+#include "CubeMakerMesh.h"
+#include "CubeMakerPlacement.h"
+#include "CubeMakerPoints.h"
+#include "CubeMakerPrimvars.h"
+#include "MemoryReport.h"
+#include "OpStats.h"
+#include "Parallel.h"
+#include "SharedAttribute.h"
+
+namespace CubeMaker
+{
+
+// Point data and lists of vertices and start indices for the cube shape
+const float g_points[] = { -0.5f, -0.5f,  0.5f,
+                            0.5f, -0.5f,  0.5f,
+                           -0.5f,  0.5f,  0.5f,
+                            0.5f,  0.5f,  0.5f,
+                           -0.5f,  0.5f, -0.5f,
+                            0.5f,  0.5f, -0.5f,
+                           -0.5f, -0.5f, -0.5f,
+                            0.5f, -0.5f, -0.5f };
+
+const int g_vertexList[] = { 2, 3, 1, 0,
+                             4, 5, 3, 2,
+                             6, 7, 5, 4,
+                             0, 1, 7, 6,
+                             3, 5, 7, 1,
+                             4, 2, 0, 6 };
+
+const int g_startIndex[] = { 0, 4, 8, 12, 16, 20, 24 };
+
+/**
+ * CubeMakerOp
+ *
+ * The CubeMaker Op implements a 'scene graph generator'-like Op, creating
+ * a number of 'polymesh' cubes on a defined location.
+ *
+ * The Op set-up is based on three main parameters:
+ *
+ * - the base parent location for all the cubes
+ * - the number of cubes to generate
+ * - the maximum rotation to be applied to the cubes
+ *
+ * The Op expects the following conventions for its arguments:
+ *
+ * - The base location is given by a string attribute, named 'location',
+ *   holding its full path, the cubes being described by a group attribute,
+ *   named 'a', alongside it. The Op creates each location on the path in
+ *   turn, passing its own arguments down unchanged, so that nothing is
+ *   decoded or rebuilt from one level to the next. Paths that aren't
+ *   absolute paths below /root are reported as an error on the root
+ *   location.
+ *
+ * - Several independent sets of cubes can be generated by a single Op from a
+ *   group attribute, named 'sets', each child of which holds the 'location'
+ *   and 'a' attributes of one set. The root location sorts the sets by
+ *   location, once, into a 'batch' argument shared by all the locations on
+ *   their paths, each one creating the children on the paths of the sets
+ *   below it. When several sets share a location, the first one is used.
+ *
+ * - Alternatively, the base location can be encoded using nested group
+ *   attributes defining a hierarchy where the elements in the location paths
+ *   are interleaved with group attributes named 'c' (for child).
+ *
+ *   For example the location '/root/world/geo/cubeMaker' will be encoded as:
+ *   'c.world.c.geo.c.cubeMaker' (notice that root has been omitted as the
+ *   root location always exists in the scene graph).
+ *
+ *   The Op will walk the attributes hierarchy building a child location for
+ *   each level.
+ *   Note: the reason to interleave the 'c' attributes is to allow the Op code
+ *   to be extended in the future without changing its arguments convention.
+ *   The 'c' group would allow further parameters to be specified for each
+ *   level in the hierarchy.
+ *
+ * - The group attribute representing the last item in the base location path
+ *   will contain a group attribute, named 'a', which in turn will hold a
+ *   integer attribute defining the number of cubes to be generated and an
+ *   optional attribute representing the maximum rotation to be applied to the
+ *   cubes.
+ *   For each cube the Op will then create a child location and it will set on
+ *   them an integer attribute, named 'leaf', containing the cube Id, and a
+ *   group attribute, named 'params', shared by all the cubes and holding the
+ *   values, other than the number of cubes, the cube transforms are derived
+ *   from (the rotation step, the maximum rotation divided by the number of
+ *   cubes, aside). When processed, leaf locations will be populated with the
+ *   'geometry' and 'xform' group attributes representing the cube shape and
+ *   transform.
+ *
+ * - The 'a' group can optionally hold an integer attribute, named
+ *   'bucketSize', bounding the number of children of any location. When more
+ *   cubes than that are requested, they are split into nested 'group_<k>'
+ *   locations, each one receiving an 'a' group holding its own range of
+ *   cubes, as 'begin' and 'end' attributes, and the 'params' group. Cube
+ *   locations keep their 'cube_<i>' names, 'i' being the index in the whole
+ *   set.
+ *
+ * - When the 'a' group holds an integer attribute, named 'spatialBuckets',
+ *   set to 1, the bucket groups are formed spatially instead of by index:
+ *   the base location sorts the cubes into a uniform grid (see
+ *   CubeMakerGrid.h), and each group, one node of the matching octree,
+ *   creates a 'group_<octant>' child for each of its non-empty octants, or
+ *   the cubes themselves once it holds at most 'bucketSize' of them (or a
+ *   single cell). The grid is built once, by the base location, and shared
+ *   with the groups as their private data. The groups depend on the number
+ *   of cubes, which is passed down alongside the octree node.
+ *
+ * - The 'a' group can optionally hold a double attribute, named
+ *   'regionOfInterest', giving a bounding box, as { xmin, xmax, ymin, ymax,
+ *   zmin, zmax }. Only the cubes that may intersect it at the frame are
+ *   created, along with the groups leading to them, the others being
+ *   skipped a whole octree node at a time, so that the cost of expanding a
+ *   sub-region only depends on the number of cubes it holds. This implies
+ *   'spatialBuckets'.
+ *
+ * - The 'a' group can optionally hold a string attribute, named 'outputMode',
+ *   selecting how the cubes are represented in the scene graph:
+ *
+ *   - 'locations' (default): one 'polymesh' location per cube, as described
+ *     above.
+ *   - 'instanceArray': a fixed number of locations regardless of the number
+ *     of cubes. An 'instance source' location, named 'instanceSource', holds
+ *     a single cube mesh, and an 'instance array' location, named
+ *     'instances', carries the per-cube transforms as arrays. These two
+ *     locations are driven by the 'source' and 'instances' Op arguments.
+ *   - 'procedural': no location at all, the base location becoming a
+ *     'renderer procedural' carrying the 'params' group and the number of
+ *     cubes as 'rendererProcedural.args', for the procedural named by the
+ *     'proceduralPath' string attribute (default 'CubeMakerProcedural') to
+ *     expand the cubes at render time, a region at a time. See
+ *     CubeMakerProcedural.h.
+ *
+ * - The 'a' group can optionally hold an integer attribute, named
+ *   'xformMatrix', which, when set to 1, has the cube transforms written as
+ *   a single 'xform.matrix' (or 'geometry.instanceMatrix' for instance
+ *   arrays) instead of separate translate, rotate and scale components.
+ *
+ * - The 'a' group can optionally hold a string attribute, named 'placement',
+ *   selecting how the cubes are laid out:
+ *
+ *   - 'line' (default): cubes of increasing size along the X axis.
+ *   - 'box': cubes scattered in a box of edge 'scatterSize'.
+ *   - 'sphere': cubes scattered on a sphere of diameter 'scatterSize'.
+ *   - 'points': cubes at the positions, and scaled by the scales, of the
+ *     point file given by the 'pointFile' string attribute, up to its number
+ *     of points. The file is memory mapped, each cook only reading the
+ *     records of its own cubes, and mapped again whenever it is replaced on
+ *     disk, which is told by its inode, size and modification time. A
+ *     double attribute named 'pointFileStamp', its modification time for
+ *     example, changes the Op arguments along with the file, for Geolib to
+ *     cook the locations again. Files must be replaced (renamed over) rather
+ *     than rewritten in place. See CubeMakerPoints.h for the file format.
+ *
+ *   The scatter modes use a counter-based random number generator keyed by
+ *   'seed', so that each cube's position only depends on its index, and all
+ *   the cubes are scaled by 'scatterScale'.
+ *
+ * - The 'a' group can optionally hold an integer attribute, named
+ *   'subdivisions', giving the cube meshes 2^subdivisions quads along each
+ *   edge (up to 6), and a double attribute, named 'roundness', rounding
+ *   their edges and corners (0 to 1). When a double attribute named
+ *   'lodDistance' is set, cubes lose one subdivision level for each
+ *   'lodDistance' they are away from the 'lodCenter' point (3 doubles,
+ *   defaulting to the origin). Each mesh is built once and shared by all
+ *   the cubes of the same level; instance arrays get one instance source
+ *   per level, named 'lod_<level>'.
+ *
+ * - The 'a' group can optionally hold double attributes, named
+ *   'rotationSpeed' (degrees per frame) and 'translationSpeed' (3 doubles,
+ *   units per frame), animating the cubes from where they are at frame 0 to
+ *   the one given by the 'frame' attribute. When an integer attribute named
+ *   'motionSamples' is greater than 1, transforms and bounds are given that
+ *   many time samples, evenly spaced from 'shutterOpen' to 'shutterClose'
+ *   (relative to the frame), all computed in one pass by each cook.
+ *
+ * - When the 'a' group holds integer attributes, named 'displayColor' or
+ *   'instanceId', set to 1, the cubes are given the matching primvars: a
+ *   random color ('color3') and the index of the cube ('int'). Leaf
+ *   locations derive their own values, as 'geometry.arbitrary', when
+ *   cooked, and instance arrays hold one array per primvar for all the
+ *   cubes, as 'instance.arbitrary'. See CubeMakerPrimvars.h.
+ *
+ * - When the 'a' group holds an integer attribute, named 'memoryReport', set
+ *   to 1, the base location is given a 'memoryReport' group attribute
+ *   estimating the bytes of attribute data held by the locations below it,
+ *   per category ('geometry', 'xform', 'bound', other attributes and the Op
+ *   arguments of the children), both as set and once the payloads shared
+ *   between locations are only counted once. See MemoryReport.h.
+ *
+ * - When the KATANAOPS_CACHE_DIR environment variable names a directory, the
+ *   arrays of the instance arrays of at least 65536 cubes are stored there,
+ *   keyed by the hash of the 'instances' and 'params' Op arguments, and
+ *   later cooks of the same arguments, in any process, map them back from
+ *   the file instead of computing them. See AttributeCache.h.
+ *
+ * All the locations created are given a 'bound' attribute, computed in
+ * closed form from the placement of the cubes they hold, so that whole
+ * subtrees can be culled without being expanded.
+ */
+
+class CubeMakerOp : public Foundry::Katana::GeolibOp
+{
+public:
+
+    static void setup(Foundry::Katana::GeolibSetupInterface &interface)
+    {
+        interface.setThreading(
+            Foundry::Katana::GeolibSetupInterface::ThreadModeConcurrent);
+    }
+
+    static void cook(Foundry::Katana::GeolibCookInterface &interface);
+
+    /**
+     * The branches of the Op, one for each kind of Op argument it handles,
+     * as reported by the cook counters
+     */
+    enum Branch
+    {
+        kBranchHierarchy = 0,
+        kBranchCubes,
+        kBranchSource,
+        kBranchMesh,
+        kBranchInstances,
+        kBranchLeaf,
+        kBranchBatch
+    };
+
+    /**
+     * Returns the cook counters of the Op, see KatanaOps::OpStats
+     */
+    static KatanaOps::OpStats& getStats()
+    {
+        static const char *const s_branchNames[] = {
+            "c", "a", "source", "mesh", "instances", "leaf", "batch", 0 };
+        static KatanaOps::OpStats s_stats("CubeMaker", s_branchNames);
+        return s_stats;
+    }
+
+    /**
+     * Implements cook() for any type providing the subset of the
+     * GeolibCookInterface used by the Op, so that the cook logic can also be
+     * driven outside of Geolib, by the benchmarks for example
+     */
+    template <typename CookInterface>
+    static void cookLocation(CookInterface &interface)
+    {
+        if (interface.atRoot())
+        {
+            interface.stopChildTraversal();
+        }
+
+        // Look for a 'sets' Op argument, describing several sets of cubes,
+        // or the 'batch' argument it is turned into
+        FnAttribute::GroupAttribute batchAttr = interface.getOpArg("batch");
+        FnAttribute::GroupAttribute setsAttr = interface.getOpArg("sets");
+        if (setsAttr.isValid() || batchAttr.isValid())
+        {
+            FnAttribute::GroupAttribute setAttr;
+            {
+                KatanaOps::ScopedCookTimer timer(getStats(), kBranchBatch);
+                if (setsAttr.isValid())
+                {
+                    batchAttr = buildBatch(setsAttr);
+                }
+                setAttr = cookBatch(interface, batchAttr);
+            }
+
+            // Generate the set whose base location is the one being cooked,
+            // if any
+            if (setAttr.isValid())
+            {
+                KatanaOps::ScopedCookTimer timer(getStats(), kBranchCubes);
+                cookCubes(interface, setAttr);
+            }
+            return;
+        }
+
+        // Look for a 'location' Op argument, giving the path of the base
+        // scene graph location that will contain the cubes
+        FnAttribute::StringAttribute locationAttr =
+            interface.getOpArg("location");
+        if (locationAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchHierarchy);
+            const std::string_view location =
+                getStringValue(locationAttr, std::string_view());
+            // The node passes the parameter as is, malformed paths, which
+            // would never be reached, are reported once, at the root
+            if (interface.atRoot() && !isValidLocation(location))
+            {
+                using Foundry::Katana::ReportError;
+                ReportError(interface,
+                    "Invalid location '" + std::string(location) +
+                    "', expected an absolute path below /root.");
+                return;
+            }
+            if (cookLocationPath(interface, location))
+            {
+                // Not at the base location yet
+                return;
+            }
+        }
+
+        // Look for a 'c' Op argument, representing an element in the
+        // hierarchy leading to the base scene graph location that will
+        // contain the cubes
+        FnAttribute::GroupAttribute cGrpAttr = interface.getOpArg("c");
+        if (cGrpAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchHierarchy);
+            cookHierarchy(interface, cGrpAttr);
+
+            // Ignore other arguments as we've already found the 'c' group
+            return;
+        }
+
+        // Look for an 'a' Op argument that will contain the attributes needed
+        // to generated the cubes
+        FnAttribute::GroupAttribute aGrpAttr = interface.getOpArg("a");
+        if (aGrpAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchCubes);
+            cookCubes(interface, aGrpAttr);
+
+            // Ignore other arguments as we've already found the 'a' group
+            return;
+        }
+
+        // Look for a 'source' Op argument, identifying the instance source
+        // location of the 'instanceArray' output mode
+        FnAttribute::GroupAttribute sourceAttr = interface.getOpArg("source");
+        if (sourceAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchSource);
+            cookSource(interface, sourceAttr);
+            return;
+        }
+
+        // Look for a 'mesh' Op argument, identifying the untransformed cube
+        // mesh under the instance source location
+        FnAttribute::GroupAttribute meshAttr = interface.getOpArg("mesh");
+        if (meshAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchMesh);
+            FnAttribute::IntAttribute levelAttr =
+                meshAttr.getChildByName("level");
+            FnAttribute::DoubleAttribute roundnessAttr =
+                meshAttr.getChildByName("roundness");
+            const FnAttribute::GroupAttribute geometryAttr = getCachedMesh(
+                levelAttr.getValue(0, false),
+                roundnessAttr.getValue(0.0, false)).get();
+            interface.setAttr("geometry", geometryAttr);
+            interface.setAttr("bound", getCachedMeshBound().get());
+            interface.setAttr("type", getCachedMeshType().get());
+            getStats().addAttribute(geometryAttr);
+            interface.stopChildTraversal();
+            return;
+        }
+
+        // Look for an 'instances' Op argument, holding the values needed to
+        // populate the instance array location
+        FnAttribute::GroupAttribute instancesAttr =
+            interface.getOpArg("instances");
+        if (instancesAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchInstances);
+            cookInstances(interface, instancesAttr);
+            interface.stopChildTraversal();
+            return;
+        }
+
+        // Look for a 'leaf' Op argument
+        FnAttribute::IntAttribute leafAttr = interface.getOpArg("leaf");
+        if (leafAttr.isValid())
+        {
+            KatanaOps::ScopedCookTimer timer(getStats(), kBranchLeaf);
+            cookLeaf(interface, leafAttr);
+            interface.stopChildTraversal();
+        }
+    }
+
+protected:
+
+    enum
+    {
+        // Smallest number of instances, or leaves, written by each task of
+        // the parallel loops, so that a task outweighs the cost of
+        // scheduling it
+        kParallelGrainSize = 16384,
+        kLeafGrainSize = 4096,
+
+        // Number of leaves whose arguments are built before the locations
+        // are created, bounding the memory held by the arguments of
+        // larger sets
+        kLeafBlockSize = 65536,
+
+        // Number of rounded meshes kept for the cooks to share, the least
+        // recently used ones being released past it
+        kMaxCachedMeshes = 32,
+
+        // Smallest number of instances whose arrays are kept in the
+        // attribute cache, below which computing them is cheaper than
+        // going through the file system
+        kMinCachedInstances = 65536
+    };
+
+    /**
+     * Returns whether the given base location is an absolute scene graph
+     * path below /root, without empty names, trailing slashes aside
+     */
+    static bool isValidLocation(std::string_view location)
+    {
+        size_t length = location.size();
+        while (length > 1 && location[length - 1] == '/')
+        {
+            --length;
+        }
+        if (location.compare(0, 5, "/root") != 0 ||
+            (length > 5 && location[5] != '/'))
+        {
+            return false;
+        }
+        for (size_t i = 5; i + 1 < length; ++i)
+        {
+            if (location[i] == '/' && location[i + 1] == '/')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Creates the next location on the path to the given base location,
+     * if the location being cooked is one of its ancestors, and returns
+     * true, or returns false if the location being cooked is the base
+     * location itself
+     */
+    template <typename CookInterface>
+    static bool cookLocationPath(CookInterface &interface,
+                                 std::string_view location)
+    {
+        const std::string outputPath = interface.getOutputLocationPath();
+        size_t length = location.size();
+        while (length > 1 && location[length - 1] == '/')
+        {
+            --length;
+        }
+
+        const size_t prefixLength = outputPath.size();
+        if (location.compare(0, length, outputPath) == 0)
+        {
+            return false;
+        }
+
+        // Locations off the path, pre-existing children of the ones on it
+        // for example, are left alone
+        if (length > prefixLength + 1 && location[prefixLength] == '/' &&
+            location.compare(0, prefixLength, outputPath) == 0)
+        {
+            const size_t nameBegin = prefixLength + 1;
+            const size_t nameEnd =
+                std::min(location.find('/', nameBegin), length);
+            if (nameEnd > nameBegin)
+            {
+                // The child is given the very same arguments, which don't
+                // depend on the level
+                interface.createChild(
+                    std::string(location.substr(nameBegin,
+                                                nameEnd - nameBegin)),
+                    "", interface.getOpArg());
+                getStats().addChildren(1);
+            }
+        }
+        interface.stopChildTraversal();
+        return true;
+    }
+
+    /**
+     * Builds and returns the 'batch' Op argument describing the sets of
+     * cubes of the given 'sets' Op argument: a 'location' string attribute
+     * holding the sorted base locations of the sets, without duplicates,
+     * and an 'a' group attribute holding the 'a' groups of the sets, in the
+     * same order
+     */
+    static FnAttribute::GroupAttribute buildBatch(
+        const FnAttribute::GroupAttribute &setsAttr)
+    {
+        typedef std::pair<std::string, int64_t> Entry;
+        std::vector<Entry> entries;
+        entries.reserve(static_cast<size_t>(setsAttr.getNumberOfChildren()));
+        for (int64_t i = 0; i < setsAttr.getNumberOfChildren(); ++i)
+        {
+            FnAttribute::GroupAttribute setAttr = setsAttr.getChildByIndex(i);
+            FnAttribute::StringAttribute locationAttr =
+                setAttr.getChildByName("location");
+            std::string location =
+                locationAttr.getValue(std::string(), false);
+            while (location.size() > 1 && location[location.size() - 1] == '/')
+            {
+                location.resize(location.size() - 1);
+            }
+            if (!location.empty() &&
+                FnAttribute::GroupAttribute(
+                    setAttr.getChildByName("a")).isValid())
+            {
+                entries.push_back(Entry(location, i));
+            }
+        }
+
+        // Sorting makes the sets below any location a contiguous range,
+        // the first set of each location coming first
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const Entry &lhs, const Entry &rhs)
+                         {
+                             return lhs.first < rhs.first;
+                         });
+
+        std::vector<std::string> locations;
+        FnAttribute::GroupAttribute::NamedAttrVector_Type setArgs;
+        std::string setName("set_");
+        const size_t prefixLength = setName.size();
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (!locations.empty() && locations.back() == entries[i].first)
+            {
+                continue;
+            }
+            FnAttribute::GroupAttribute setAttr =
+                setsAttr.getChildByIndex(entries[i].second);
+            setIndexedName(setName, prefixLength,
+                           static_cast<int>(locations.size()));
+            setArgs.push_back(FnAttribute::GroupAttribute::NamedAttr_Type(
+                setName, setAttr.getChildByName("a")));
+            locations.push_back(entries[i].first);
+        }
+
+        return FnAttribute::GroupAttribute(
+            "location", FnAttribute::StringAttribute(locations),
+            "a", FnAttribute::GroupAttribute(setArgs, true),
+            true);
+    }
+
+    /**
+     * Creates the children of the location being cooked leading to the base
+     * locations of the sets of cubes below it, as described by the given
+     * 'batch' Op argument, and returns the 'a' group of the set based at the
+     * location being cooked, if any
+     */
+    template <typename CookInterface>
+    static FnAttribute::GroupAttribute cookBatch(
+        CookInterface &interface, const FnAttribute::GroupAttribute &batchAttr)
+    {
+        FnAttribute::StringAttribute locationAttr =
+            batchAttr.getChildByName("location");
+        FnAttribute::GroupAttribute aGrpAttr = batchAttr.getChildByName("a");
+        const FnAttribute::StringConstVector locations =
+            locationAttr.getNearestSample(0.0f);
+        const char *const *first = locations.begin();
+        const char *const *last = locations.end();
+
+        struct Less
+        {
+            bool operator()(const char *lhs, const char *rhs) const
+            {
+                return std::strcmp(lhs, rhs) < 0;
+            }
+        };
+
+        std::string path = interface.getOutputLocationPath();
+        const char *const *base =
+            std::lower_bound(first, last, path.c_str(), Less());
+        FnAttribute::GroupAttribute setAttr;
+        if (base != last && path == *base)
+        {
+            setAttr = aGrpAttr.getChildByIndex(base - first);
+        }
+
+        // The locations below this one are the ones from "<path>/" to
+        // "<path>0", '0' following '/'
+        path += '/';
+        const size_t prefixLength = path.size();
+        const char *const *begin =
+            std::lower_bound(base, last, path.c_str(), Less());
+        path[prefixLength - 1] = '0';
+        const char *const *end =
+            std::lower_bound(begin, last, path.c_str(), Less());
+
+        // The sets below a child aren't necessarily contiguous, "a-b"
+        // sorting between "a" and "a/b"
+        std::vector<std::string> childNames;
+        for (const char *const *it = begin; it != end; ++it)
+        {
+            const char *name = *it + prefixLength;
+            const size_t nameLength = std::strcspn(name, "/");
+            if (nameLength > 0 &&
+                (childNames.empty() ||
+                 childNames.back().compare(0, std::string::npos, name,
+                                           nameLength) != 0))
+            {
+                childNames.push_back(std::string(name, nameLength));
+            }
+        }
+        std::sort(childNames.begin(), childNames.end());
+        childNames.erase(std::unique(childNames.begin(), childNames.end()),
+                         childNames.end());
+
+        // All the children are given the same arguments
+        const FnAttribute::GroupAttribute childArgs(
+            "batch", batchAttr, true);
+        for (size_t i = 0; i < childNames.size(); ++i)
+        {
+            interface.createChild(childNames[i], "", childArgs);
+        }
+        getStats().addChildren(childNames.size());
+
+        if (!setAttr.isValid())
+        {
+            interface.stopChildTraversal();
+        }
+        return setAttr;
+    }
+
+    /**
+     * Creates the next location in the hierarchy leading to the base
+     * location of the cubes, as described by the given 'c' Op argument
+     */
+    template <typename CookInterface>
+    static void cookHierarchy(CookInterface &interface,
+                              const FnAttribute::GroupAttribute &cGrpAttr)
+    {
+        using Foundry::Katana::ReportError;
+
+        const int64_t numChildren = cGrpAttr.getNumberOfChildren();
+        if (numChildren != 1)
+        {
+            // We expected exactly one child attribute in 'c', if it's not
+            // the case we notify the user with an error
+            ReportError(interface, "Unsupported attributes convention.");
+            interface.stopChildTraversal();
+            return;
+        }
+
+        const std::string childName =
+            FnAttribute::DelimiterDecode(cGrpAttr.getChildName(0));
+        FnAttribute::GroupAttribute childArgs = cGrpAttr.getChildByIndex(0);
+        // Create a child location using the attribute name and forwarding
+        // the hierarchy information
+        interface.createChild(childName, "", childArgs);
+        getStats().addChildren(1);
+    }
+
+    /**
+     * Creates the locations representing the cubes described by the given
+     * 'a' Op argument, or the bucket groups leading to them
+     */
+    template <typename CookInterface>
+    static void cookCubes(CookInterface &interface,
+                          const FnAttribute::GroupAttribute &aGrpAttr)
+    {
+        using Foundry::Katana::ReportError;
+
+        FnAttribute::IntAttribute numberOfCubesAttr =
+            aGrpAttr.getChildByName("numberOfCubes");
+        FnAttribute::StringAttribute outputModeAttr =
+            aGrpAttr.getChildByName("outputMode");
+        FnAttribute::StringAttribute placementAttr =
+            aGrpAttr.getChildByName("placement");
+
+        Placement::Mode placementMode;
+        const std::string_view placement =
+            getStringValue(placementAttr, "line");
+        if (!getPlacementMode(placement, placementMode))
+        {
+            ReportError(interface,
+                "Unsupported placement '" + std::string(placement) + "'.");
+            interface.stopChildTraversal();
+            return;
+        }
+
+        // The base location derives the 'params' group from its arguments,
+        // the bucket groups are given it
+        FnAttribute::GroupAttribute paramsAttr = interface.getOpArg("params");
+        const bool baseLocation = !paramsAttr.isValid();
+        if (baseLocation)
+        {
+            paramsAttr = buildParams(aGrpAttr);
+        }
+        PointFilePtr pointFile;
+        Placement cubesPlacement = getPlacement(paramsAttr, pointFile);
+        cubesPlacement.numberOfCubes =
+            std::max(numberOfCubesAttr.getValue(0, false), 0);
+        const MotionSamples motion = getMotionSamples(paramsAttr);
+
+        // The points placement can't place more cubes than there are points
+        if (cubesPlacement.mode == Placement::kModePoints)
+        {
+            std::string error;
+            if (!pointFile)
+            {
+                pointFile = getPlacementPointFile(paramsAttr, error);
+            }
+            if (!pointFile)
+            {
+                FnAttribute::StringAttribute pointFileAttr =
+                    paramsAttr.getChildByName("pointFile");
+                ReportError(interface,
+                    "Cannot read point file '" +
+                    pointFileAttr.getValue(std::string(), false) + "': " +
+                    error + ".");
+                interface.stopChildTraversal();
+                return;
+            }
+            cubesPlacement.points = &pointFile->points;
+            cubesPlacement.numberOfCubes = static_cast<int>(std::min<int64_t>(
+                cubesPlacement.numberOfCubes,
+                pointFile->points.numberOfPoints));
+        }
+
+        FnAttribute::IntAttribute memoryReportAttr =
+            aGrpAttr.getChildByName("memoryReport");
+        if (baseLocation && memoryReportAttr.getValue(0, false) != 0)
+        {
+            interface.setAttr("memoryReport", buildMemoryReport(
+                interface.getOutputLocationPath(), aGrpAttr,
+                cubesPlacement.numberOfCubes));
+        }
+
+        const std::string_view outputMode =
+            getStringValue(outputModeAttr, "locations");
+        if (outputMode == "instanceArray")
+        {
+            if (cubesPlacement.numberOfCubes > 0)
+            {
+                interface.setAttr("bound", buildBound(
+                    cubesPlacement, motion, 0, cubesPlacement.numberOfCubes));
+            }
+
+            // Only two locations are created, however many cubes are
+            // requested: the instance source holding the cube mesh (or one
+            // instance source per LOD level), and the instance array
+            // pointing at it
+            const MeshDetail detail = getMeshDetail(paramsAttr);
+            const int numberOfLevels = detail.getNumberOfLevels();
+
+            const std::string sourcePath =
+                interface.getOutputLocationPath() + "/instanceSource";
+            std::vector<std::string> sourcePaths;
+            if (numberOfLevels > 1)
+            {
+                std::string levelPath = sourcePath + "/lod_";
+                const size_t prefixLength = levelPath.size();
+                for (int level = 0; level < numberOfLevels; ++level)
+                {
+                    setIndexedName(levelPath, prefixLength, level);
+                    sourcePaths.push_back(levelPath);
+                }
+            }
+            else
+            {
+                sourcePaths.push_back(sourcePath);
+            }
+
+            FnAttribute::GroupBuilder sourceBuilder;
+            sourceBuilder.set("level",
+                              FnAttribute::IntAttribute(detail.subdivisions));
+            sourceBuilder.set("numberOfLevels",
+                              FnAttribute::IntAttribute(numberOfLevels));
+            sourceBuilder.set("roundness",
+                              FnAttribute::DoubleAttribute(detail.roundness));
+            interface.createChild(
+                "instanceSource", "",
+                FnAttribute::GroupAttribute(
+                    "source", sourceBuilder.build(), true));
+
+            interface.createChild(
+                "instances", "",
+                FnAttribute::GroupAttribute(
+                    "instances", FnAttribute::GroupAttribute(
+                        "instanceSource",
+                        FnAttribute::StringAttribute(sourcePaths),
+                        "numberOfCubes",
+                        FnAttribute::IntAttribute(
+                            cubesPlacement.numberOfCubes),
+                        true),
+                    "params", paramsAttr,
+                    true));
+            getStats().addChildren(2);
+            return;
+        }
+        else if (outputMode == "procedural")
+        {
+            // The cubes are expanded by the renderer, see
+            // CubeMakerProcedural.h: the location only carries the compact
+            // arguments they derive from
+            if (cubesPlacement.numberOfCubes > 0)
+            {
+                interface.setAttr("bound", buildBound(
+                    cubesPlacement, motion, 0, cubesPlacement.numberOfCubes));
+            }
+            FnAttribute::StringAttribute proceduralPathAttr =
+                aGrpAttr.getChildByName("proceduralPath");
+            FnAttribute::GroupBuilder argsBuilder;
+            argsBuilder.update(paramsAttr);
+            argsBuilder.set("numberOfCubes", FnAttribute::IntAttribute(
+                cubesPlacement.numberOfCubes));
+            interface.setAttr("type", FnAttribute::StringAttribute(
+                "renderer procedural"));
+            interface.setAttr("rendererProcedural.procedural",
+                              FnAttribute::StringAttribute(
+                                  proceduralPathAttr.getValue(
+                                      "CubeMakerProcedural", false)));
+            interface.setAttr("rendererProcedural.args", argsBuilder.build());
+            interface.stopChildTraversal();
+            return;
+        }
+        else if (outputMode != "locations")
+        {
+            ReportError(interface,
+                "Unsupported output mode '" + std::string(outputMode) +
+                "'.");
+            interface.stopChildTraversal();
+            return;
+        }
+
+        // Spatial groups, and region queries, go through the grid of the
+        // cube positions
+        FnAttribute::IntAttribute spatialBucketsAttr =
+            aGrpAttr.getChildByName("spatialBuckets");
+        FnAttribute::DoubleAttribute regionOfInterestAttr =
+            aGrpAttr.getChildByName("regionOfInterest");
+        if (spatialBucketsAttr.getValue(0, false) != 0 ||
+            regionOfInterestAttr.isValid())
+        {
+            cookSpatialCubes(interface, aGrpAttr, paramsAttr, cubesPlacement,
+                             motion);
+            return;
+        }
+
+        FnAttribute::IntAttribute beginAttr =
+            aGrpAttr.getChildByName("begin");
+        FnAttribute::IntAttribute endAttr =
+            aGrpAttr.getChildByName("end");
+        FnAttribute::IntAttribute bucketSizeAttr =
+            aGrpAttr.getChildByName("bucketSize");
+
+        // The range of cubes handled by this location: all of them for the
+        // base location, a subset for a bucket group
+        const int begin = std::max(beginAttr.getValue(0, false), 0);
+        const int end = endAttr.getValue(cubesPlacement.numberOfCubes, false);
+        const int bucketSize = bucketSizeAttr.getValue(0, false);
+        if (begin >= end)
+        {
+            return;
+        }
+
+        interface.setAttr("bound",
+                          buildBound(cubesPlacement, motion, begin, end));
+
+        if (bucketSize > 1 && end - begin > bucketSize)
+        {
+            // Too many cubes for a single location: split the range into at
+            // most 'bucketSize' groups, each spanning a power of
+            // 'bucketSize' cubes, and let each group recurse
+            const int64_t count = end - begin;
+            int64_t span = bucketSize;
+            while (span * bucketSize < count)
+            {
+                span *= bucketSize;
+            }
+
+            std::string childName("group_");
+            const size_t prefixLength = childName.size();
+
+            int bucket = 0;
+            for (int64_t bucketBegin = begin; bucketBegin < end;
+                 bucketBegin += span, ++bucket)
+            {
+                const int64_t bucketEnd =
+                    std::min<int64_t>(bucketBegin + span, end);
+
+                // Only the range depends on the number of cubes, so that the
+                // groups whose range is unchanged keep the same arguments
+                // (unless the rotation step of 'params' changes with it, see
+                // buildParams())
+                FnAttribute::GroupBuilder childArgsBuilder;
+                childArgsBuilder.set("begin", FnAttribute::IntAttribute(
+                    static_cast<int>(bucketBegin)));
+                childArgsBuilder.set("end", FnAttribute::IntAttribute(
+                    static_cast<int>(bucketEnd)));
+                childArgsBuilder.set("bucketSize",
+                                     FnAttribute::IntAttribute(bucketSize));
+                setIndexedName(childName, prefixLength, bucket);
+                interface.createChild(
+                    childName, "",
+                    FnAttribute::GroupAttribute(
+                        "a", childArgsBuilder.build(),
+                        "params", paramsAttr,
+                        true));
+            }
+            getStats().addChildren(bucket);
+            return;
+        }
+
+        createLeaves(interface, static_cast<size_t>(end - begin),
+            [begin](size_t i) { return begin + static_cast<int>(i); },
+            paramsAttr);
+    }
+
+    /**
+     * Creates the leaf locations of 'numberOfLeaves' cubes, the i-th one
+     * being the cube of index getIndex(i), that will be turned into
+     * 'polymesh' cubes.
+     *
+     * The values the cube transforms are derived from are the same for all
+     * the leaves, so every child references the same 'params' attribute.
+     * The arguments of the leaves are built in parallel, a block at a time,
+     * the locations then being created in order by the cooking thread, the
+     * only one that can use the cook interface.
+     */
+    template <typename CookInterface, typename IndexFunction>
+    static void createLeaves(CookInterface &interface, size_t numberOfLeaves,
+                             const IndexFunction &getIndex,
+                             const FnAttribute::GroupAttribute &paramsAttr)
+    {
+        // Reuse the same name buffer for all the children, only the index
+        // digits change from one cube to the next
+        std::string childName("cube_");
+        const size_t prefixLength = childName.size();
+        childName.reserve(prefixLength + 16);
+
+        std::vector<FnAttribute::GroupAttribute> blockArgs(
+            std::min<size_t>(numberOfLeaves, kLeafBlockSize));
+        for (size_t blockBegin = 0; blockBegin < numberOfLeaves;
+             blockBegin += kLeafBlockSize)
+        {
+            const size_t blockEnd =
+                std::min<size_t>(blockBegin + kLeafBlockSize, numberOfLeaves);
+            KatanaOps::parallelFor(blockBegin, blockEnd, kLeafGrainSize,
+                [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        blockArgs[i - blockBegin] = FnAttribute::GroupAttribute(
+                            "leaf", FnAttribute::IntAttribute(getIndex(i)),
+                            "params", paramsAttr,
+                            true);
+                    }
+                });
+
+            for (size_t i = blockBegin; i < blockEnd; ++i)
+            {
+                setIndexedName(childName, prefixLength, getIndex(i));
+                interface.createChild(childName, "",
+                                      blockArgs[i - blockBegin]);
+            }
+        }
+        getStats().addChildren(numberOfLeaves);
+    }
+
+    /**
+     * Creates the locations representing the cubes of the octree node
+     * described by the given 'a' Op argument, the whole grid for the base
+     * location, or the spatial groups leading to them, see CubeGrid
+     */
+    template <typename CookInterface>
+    static void cookSpatialCubes(CookInterface &interface,
+                                 const FnAttribute::GroupAttribute &aGrpAttr,
+                                 const FnAttribute::GroupAttribute &paramsAttr,
+                                 const Placement &placement,
+                                 const MotionSamples &motion)
+    {
+        FnAttribute::IntAttribute levelAttr =
+            aGrpAttr.getChildByName("spatialLevel");
+        FnAttribute::IntAttribute nodeAttr =
+            aGrpAttr.getChildByName("spatialNode");
+        FnAttribute::IntAttribute bucketSizeAttr =
+            aGrpAttr.getChildByName("bucketSize");
+        FnAttribute::DoubleAttribute regionOfInterestAttr =
+            aGrpAttr.getChildByName("regionOfInterest");
+
+        // The groups are given the grid of the base location, which is only
+        // built again when missing
+        std::shared_ptr<const CubeGrid> grid;
+        if (const void *privateData = interface.getPrivateData())
+        {
+            grid = *static_cast<const std::shared_ptr<const CubeGrid>*>(
+                privateData);
+        }
+        if (!grid || grid->getNumberOfCubes() != placement.numberOfCubes)
+        {
+            grid = std::make_shared<CubeGrid>(placement);
+        }
+
+        const int level = std::min(std::max(levelAttr.getValue(0, false), 0),
+                                   grid->getDepth());
+        const uint32_t node =
+            static_cast<uint32_t>(nodeAttr.getValue(0, false));
+        const int bucketSize = bucketSizeAttr.getValue(0, false);
+        const int numberOfCubes = grid->getNumberOfCubes(level, node);
+        if (numberOfCubes == 0)
+        {
+            return;
+        }
+
+        double region[6];
+        const bool hasRegion = regionOfInterestAttr.getNumberOfValues() == 6;
+        if (hasRegion)
+        {
+            FnAttribute::DoubleConstVector values =
+                regionOfInterestAttr.getNearestSample(0.0f);
+            std::copy(values.begin(), values.end(), region);
+        }
+
+        interface.setAttr("bound", buildSampledBound(placement, motion,
+            [&](const Placement &samplePlacement, double *bound)
+            {
+                grid->getNodeBound(level, node, samplePlacement, bound);
+            }));
+
+        if (bucketSize > 1 && numberOfCubes > bucketSize &&
+            level < grid->getDepth())
+        {
+            std::string childName("group_");
+            const size_t prefixLength = childName.size();
+
+            int numberOfChildren = 0;
+            for (uint32_t octant = 0; octant < 8; ++octant)
+            {
+                // Skip the nodes holding all the cubes of their parent, so
+                // that clustered cubes don't make chains of single groups
+                int childLevel = level + 1;
+                uint32_t childNode = node * 8 + octant;
+                const int childNumberOfCubes =
+                    grid->getNumberOfCubes(childLevel, childNode);
+                if (childNumberOfCubes == 0)
+                {
+                    continue;
+                }
+                while (childNumberOfCubes > bucketSize &&
+                       childLevel < grid->getDepth())
+                {
+                    uint32_t onlyNode = 0;
+                    int numberOfNodes = 0;
+                    for (uint32_t childOctant = 0; childOctant < 8;
+                         ++childOctant)
+                    {
+                        const uint32_t grandchildNode =
+                            childNode * 8 + childOctant;
+                        if (grid->getNumberOfCubes(childLevel + 1,
+                                                   grandchildNode) > 0)
+                        {
+                            onlyNode = grandchildNode;
+                            ++numberOfNodes;
+                        }
+                    }
+                    if (numberOfNodes != 1)
+                    {
+                        break;
+                    }
+                    ++childLevel;
+                    childNode = onlyNode;
+                }
+
+                if (hasRegion)
+                {
+                    double bound[6];
+                    grid->getNodeBound(childLevel, childNode, placement,
+                                       bound);
+                    if (!getBoundsIntersect(bound, region))
+                    {
+                        continue;
+                    }
+                }
+
+                FnAttribute::GroupBuilder childArgsBuilder;
+                childArgsBuilder.set("numberOfCubes", FnAttribute::IntAttribute(
+                    placement.numberOfCubes));
+                childArgsBuilder.set("bucketSize",
+                                     FnAttribute::IntAttribute(bucketSize));
+                childArgsBuilder.set("spatialBuckets",
+                                     FnAttribute::IntAttribute(1));
+                childArgsBuilder.set("spatialLevel",
+                                     FnAttribute::IntAttribute(childLevel));
+                childArgsBuilder.set("spatialNode", FnAttribute::IntAttribute(
+                    static_cast<int>(childNode)));
+                if (hasRegion)
+                {
+                    childArgsBuilder.set("regionOfInterest",
+                                         regionOfInterestAttr);
+                }
+                setIndexedName(childName, prefixLength,
+                               static_cast<int>(octant));
+                interface.createChild(
+                    childName, "",
+                    FnAttribute::GroupAttribute(
+                        "a", childArgsBuilder.build(),
+                        "params", paramsAttr,
+                        true),
+                    Foundry::Katana::GeolibCookInterface::ResetRootAuto,
+                    new std::shared_ptr<const CubeGrid>(grid),
+                    deleteSharedGrid);
+                ++numberOfChildren;
+            }
+            getStats().addChildren(numberOfChildren);
+            return;
+        }
+
+        // The leaves are the same as the ones of the index groups
+        std::vector<int> cubes;
+        if (hasRegion)
+        {
+            grid->getCubesInRegion(level, node, placement, region, cubes);
+        }
+        else
+        {
+            const int *nodeCubes = grid->getCubes(level, node);
+            cubes.assign(nodeCubes, nodeCubes + numberOfCubes);
+        }
+
+        createLeaves(interface, cubes.size(),
+            [&cubes](size_t i) { return cubes[i]; }, paramsAttr);
+    }
+
+    /**
+     * Deletes the reference to a grid given to a spatial group as its
+     * private data
+     */
+    static void deleteSharedGrid(void *privateData)
+    {
+        delete static_cast<std::shared_ptr<const CubeGrid>*>(privateData);
+    }
+
+    /**
+     * Returns the 'memoryReport' attribute of the base location of the given
+     * path, estimating the memory held by the locations generated below it
+     * from the given 'a' Op argument, see KatanaOps::MemoryReport, along
+     * with the resident bytes per cube.
+     *
+     * The locations are cooked, outside of Geolib, up to the report budget,
+     * their parents creating all their children: better used with
+     * 'bucketSize' set, and once per change of the parameters, as a debug
+     * tool.
+     */
+    static FnAttribute::GroupAttribute buildMemoryReport(
+        const std::string &path, const FnAttribute::GroupAttribute &aGrpAttr,
+        int numberOfCubes)
+    {
+        // Cook the base location as a standalone set of cubes, without the
+        // report, so that it isn't built again
+        FnAttribute::GroupBuilder aBuilder;
+        aBuilder.update(aGrpAttr);
+        aBuilder.del("memoryReport");
+
+        KatanaOps::MemoryReport report;
+        report.walk<CubeMakerOp>(
+            FnAttribute::GroupAttribute("a", aBuilder.build(), true), path);
+
+        const FnAttribute::GroupAttribute reportAttr = report.buildAttr();
+        FnAttribute::DoubleAttribute residentBytesAttr =
+            reportAttr.getChildByName("residentBytes");
+        FnAttribute::GroupBuilder gb;
+        gb.update(reportAttr);
+        gb.set("numberOfCubes", FnAttribute::IntAttribute(numberOfCubes));
+        gb.set("residentBytesPerCube", FnAttribute::DoubleAttribute(
+            numberOfCubes > 0 ?
+                residentBytesAttr.getValue(0.0, false) / numberOfCubes : 0.0));
+        return gb.build();
+    }
+
+    /**
+     * Populates the instance source location described by the given
+     * 'source' Op argument, or, when the instances use several LOD levels, a
+     * group holding one instance source per level
+     */
+    template <typename CookInterface>
+    static void cookSource(CookInterface &interface,
+                           const FnAttribute::GroupAttribute &sourceAttr)
+    {
+        FnAttribute::IntAttribute levelAttr =
+            sourceAttr.getChildByName("level");
+        FnAttribute::IntAttribute numberOfLevelsAttr =
+            sourceAttr.getChildByName("numberOfLevels");
+        FnAttribute::DoubleAttribute roundnessAttr =
+            sourceAttr.getChildByName("roundness");
+        const FnAttribute::DoubleAttribute roundness(
+            roundnessAttr.getValue(0.0, false));
+
+        const int numberOfLevels = numberOfLevelsAttr.getValue(1, false);
+        if (numberOfLevels > 1)
+        {
+            interface.setAttr("type", FnAttribute::StringAttribute("group"));
+
+            std::string childName("lod_");
+            const size_t prefixLength = childName.size();
+            for (int level = 0; level < numberOfLevels; ++level)
+            {
+                setIndexedName(childName, prefixLength, level);
+                interface.createChild(
+                    childName, "",
+                    FnAttribute::GroupAttribute(
+                        "source", FnAttribute::GroupAttribute(
+                            "level", FnAttribute::IntAttribute(level),
+                            "roundness", roundness,
+                            true),
+                        true));
+            }
+            getStats().addChildren(numberOfLevels);
+            return;
+        }
+
+        interface.setAttr("type",
+                          FnAttribute::StringAttribute("instance source"));
+        interface.createChild(
+            "cube", "",
+            FnAttribute::GroupAttribute(
+                "mesh", FnAttribute::GroupAttribute(
+                    "level",
+                    FnAttribute::IntAttribute(levelAttr.getValue(0, false)),
+                    "roundness", roundness,
+                    true),
+                true));
+        getStats().addChildren(1);
+    }
+
+    /**
+     * Populates the instance array location described by the given
+     * 'instances' Op argument and the shared 'params' Op argument
+     */
+    template <typename CookInterface>
+    static void cookInstances(CookInterface &interface,
+                              const FnAttribute::GroupAttribute &instancesAttr)
+    {
+        FnAttribute::GroupAttribute paramsAttr = interface.getOpArg("params");
+        FnAttribute::IntAttribute xformMatrixAttr =
+            paramsAttr.getChildByName("xformMatrix");
+        FnAttribute::StringAttribute instanceSourceAttr =
+            instancesAttr.getChildByName("instanceSource");
+
+        const bool xformMatrix = xformMatrixAttr.getValue(0, false) != 0;
+
+        FnAttribute::IntAttribute numberOfCubesAttr =
+            instancesAttr.getChildByName("numberOfCubes");
+
+        PointFilePtr pointFile;
+        Placement placement = getPlacement(paramsAttr, pointFile);
+        placement.numberOfCubes =
+            std::max(numberOfCubesAttr.getValue(0, false), 0);
+        const MotionSamples motion = getMotionSamples(paramsAttr);
+        const Primvars primvars = getPrimvars(paramsAttr);
+
+        // The arrays of larger sets are looked up in the attribute cache
+        // first, the points placement being keyed by the point file identity
+        KatanaOps::AttributeCache *cache =
+            placement.numberOfCubes >= kMinCachedInstances ?
+            KatanaOps::AttributeCache::getDefault() : nullptr;
+        FnAttribute::GroupAttribute cacheKeyAttr;
+        FnAttribute::GroupAttribute cachedAttr;
+        if (cache)
+        {
+            FnAttribute::GroupBuilder cacheKeyBuilder;
+            cacheKeyBuilder.set("instances", instancesAttr);
+            cacheKeyBuilder.set("params", paramsAttr);
+            if (pointFile)
+            {
+                // The device differs between the hosts sharing the file
+                const KatanaOps::FileIdentity &identity =
+                    pointFile->file.identity();
+                cacheKeyBuilder.set("pointFile", FnAttribute::StringAttribute(
+                    std::to_string(identity.inode) + ":" +
+                    std::to_string(identity.size) + ":" +
+                    std::to_string(identity.modificationTime)));
+            }
+            cacheKeyAttr = cacheKeyBuilder.build();
+            cachedAttr = cache->load(cacheKeyAttr);
+        }
+
+        FnAttribute::Attribute geometryAttr;
+        FnAttribute::GroupAttribute arbitraryAttr;
+        if (cachedAttr.isValid())
+        {
+            geometryAttr = cachedAttr.getChildByName("geometry");
+            arbitraryAttr = cachedAttr.getChildByName("arbitrary");
+        }
+        else
+        {
+            geometryAttr = buildInstanceArray(
+                instanceSourceAttr, placement, motion,
+                getMeshDetail(paramsAttr), xformMatrix);
+            if (primvars.any())
+            {
+                arbitraryAttr = buildInstancePrimvars(placement, primvars);
+            }
+            if (cache)
+            {
+                FnAttribute::GroupBuilder cachedBuilder;
+                cachedBuilder.set("geometry", geometryAttr);
+                if (arbitraryAttr.isValid())
+                {
+                    cachedBuilder.set("arbitrary", arbitraryAttr);
+                }
+                cache->store(cacheKeyAttr, cachedBuilder.build());
+            }
+        }
+
+        interface.setAttr("type",
+                          FnAttribute::StringAttribute("instance array"));
+        interface.setAttr("geometry", geometryAttr);
+        if (placement.numberOfCubes > 0)
+        {
+            interface.setAttr("bound", buildBound(
+                placement, motion, 0, placement.numberOfCubes));
+        }
+        getStats().addAttribute(geometryAttr);
+
+        if (arbitraryAttr.isValid())
+        {
+            interface.setAttr("instance.arbitrary", arbitraryAttr);
+            getStats().addAttribute(arbitraryAttr);
+        }
+    }
+
+    /**
+     * Populates the leaf location of the cube with the given index, taking
+     * the values its transform is derived from from the shared 'params' Op
+     * argument
+     */
+    template <typename CookInterface>
+    static void cookLeaf(CookInterface &interface,
+                         const FnAttribute::IntAttribute &leafAttr)
+    {
+        FnAttribute::GroupAttribute paramsAttr = interface.getOpArg("params");
+        FnAttribute::IntAttribute xformMatrixAttr =
+            paramsAttr.getChildByName("xformMatrix");
+        PointFilePtr pointFile;
+        const Placement placement = getPlacement(paramsAttr, pointFile);
+        const MotionSamples motion = getMotionSamples(paramsAttr);
+        const MeshDetail detail = getMeshDetail(paramsAttr);
+        const int index = leafAttr.getValue(0 , false);
+        const bool xformMatrix = xformMatrixAttr.getValue(0, false) != 0;
+
+        FnAttribute::Attribute xformAttr;
+        if (motion.numberOfSamples > 1)
+        {
+            xformAttr = buildSampledTransform(index, placement, motion,
+                                              xformMatrix);
+        }
+        else
+        {
+            const double rotation = getCubeRotation(index, placement);
+            xformAttr = xformMatrix ?
+                buildTransformMatrix(index, rotation, placement) :
+                buildTransform(index, rotation, placement);
+        }
+        const FnAttribute::GroupAttribute geometryAttr = getCachedMesh(
+            getCubeLevel(index, placement, detail), detail.roundness).get();
+
+        interface.setAttr("geometry", geometryAttr);
+        interface.setAttr("xform", xformAttr);
+        interface.setAttr("bound", getCachedMeshBound().get());
+        interface.setAttr("type", getCachedMeshType().get());
+
+        KatanaOps::OpStats &stats = getStats();
+        stats.addAttribute(geometryAttr);
+        stats.addAttribute(xformAttr);
+
+        // The primvars are set alongside the shared mesh, which stays shared
+        const Primvars primvars = getPrimvars(paramsAttr);
+        if (primvars.any())
+        {
+            const FnAttribute::GroupAttribute arbitraryAttr =
+                buildLeafPrimvars(index, placement, primvars);
+            interface.setAttr("geometry.arbitrary", arbitraryAttr);
+            stats.addAttribute(arbitraryAttr);
+        }
+    }
+
+    /**
+     * Returns the cube geometry group attribute shared by all the leaf
+     * locations.
+     *
+     * The attribute is built, and hashed, once, on first use, and then
+     * handed out by reference so that every cube points to the same
+     * immutable payload, which Geolib can then share and dedupe in its cache
+     * without hashing it again. Initialisation of the function-local static
+     * is thread-safe, so this can be called from concurrent cooks.
+     */
+    static const KatanaOps::SharedGroupAttribute& getCachedGeometry()
+    {
+        static const KatanaOps::SharedGroupAttribute s_geometry(
+            buildGeometry());
+        return s_geometry;
+    }
+
+    /**
+     * Builds and returns a group attribute representing the cube geometry
+     */
+    static FnAttribute::GroupAttribute buildGeometry()
+    {
+        FnAttribute::GroupBuilder gb;
+
+        // The tables are constant, so reference them instead of copying
+        FnAttribute::GroupBuilder gbPoint;
+        gbPoint.set("P",
+                    KatanaOps::wrapStaticData<FnAttribute::FloatAttribute>(
+                        g_points, sizeof(g_points) / sizeof(float), 3));
+        gb.set("point", gbPoint.build());
+
+        FnAttribute::GroupBuilder gbPoly;
+        gbPoly.set("vertexList",
+                   KatanaOps::wrapStaticData<FnAttribute::IntAttribute>(
+                       g_vertexList, sizeof(g_vertexList) / sizeof(int), 1));
+        gbPoly.set("startIndex",
+                   KatanaOps::wrapStaticData<FnAttribute::IntAttribute>(
+                       g_startIndex, sizeof(g_startIndex) / sizeof(int), 1));
+        gb.set("poly", gbPoly.build());
+
+        return gb.build();
+    }
+
+    /**
+     * Returns the 'bound' attribute of the cube meshes, in their local
+     * space, which is the same for all the levels and roundnesses
+     */
+    static const KatanaOps::SharedDoubleAttribute& getCachedMeshBound()
+    {
+        static const double s_values[] = { -0.5, 0.5, -0.5, 0.5, -0.5, 0.5 };
+        static const KatanaOps::SharedDoubleAttribute s_bound(
+            FnAttribute::DoubleAttribute(s_values, 6, 2));
+        return s_bound;
+    }
+
+    /**
+     * Returns the 'type' attribute of the cube mesh locations
+     */
+    static const KatanaOps::SharedStringAttribute& getCachedMeshType()
+    {
+        static const KatanaOps::SharedStringAttribute s_type(
+            FnAttribute::StringAttribute("polymesh"));
+        return s_type;
+    }
+
+    /**
+     * Returns the 'bound' attribute of a location holding the cubes of
+     * indices in [begin, end), which must not be empty, with the given time
+     * samples, see getCubesBound()
+     */
+    static FnAttribute::DoubleAttribute buildBound(
+        const Placement &placement, const MotionSamples &motion, int begin,
+        int end)
+    {
+        return buildSampledBound(placement, motion,
+            [=](const Placement &samplePlacement, double *bound)
+            {
+                getCubesBound(begin, end, samplePlacement, bound);
+            });
+    }
+
+    /**
+     * Returns a 'bound' attribute with the given time samples, each one
+     * written by the given function from the placement at its time
+     */
+    template <typename BoundFunction>
+    static FnAttribute::DoubleAttribute buildSampledBound(
+        const Placement &placement, const MotionSamples &motion,
+        const BoundFunction &boundFunction)
+    {
+        if (motion.numberOfSamples <= 1)
+        {
+            double bound[6];
+            boundFunction(placement, bound);
+            return FnAttribute::DoubleAttribute(bound, 6, 2);
+        }
+
+        float times[MotionSamples::kMaxSamples];
+        double bounds[MotionSamples::kMaxSamples][6];
+        const double *samples[MotionSamples::kMaxSamples];
+        for (int sample = 0; sample < motion.numberOfSamples; ++sample)
+        {
+            times[sample] = motion.getSampleTime(sample);
+            Placement samplePlacement = placement;
+            samplePlacement.time += times[sample];
+            boundFunction(samplePlacement, bounds[sample]);
+            samples[sample] = bounds[sample];
+        }
+        return FnAttribute::DoubleAttribute(
+            times, motion.numberOfSamples, samples, 6, 2);
+    }
+
+    /**
+     * Returns the cube geometry of the given subdivision level and
+     * roundness, shared by all the locations using it.
+     *
+     * Each combination is built, and hashed, once, on first use. The sharp
+     * meshes, of the default roundness, are kept for the lifetime of the
+     * plug-in, the plain cube being the one returned by getCachedGeometry().
+     * Rounded ones are kept in a cache of the kMaxCachedMeshes most
+     * recently used, so that animating the roundness doesn't grow the
+     * memory held without bound: a mesh evicted while still set on
+     * locations is built again, and shared anew, by the next cook using it.
+     */
+    static KatanaOps::SharedGroupAttribute getCachedMesh(int level,
+                                                         double roundness)
+    {
+        level = std::min(std::max(level, 0),
+                         static_cast<int>(MeshDetail::kMaxSubdivisions));
+        if (roundness <= 0.0)
+        {
+            if (level == 0)
+            {
+                return getCachedGeometry();
+            }
+            static std::once_flag s_flags[MeshDetail::kMaxSubdivisions + 1];
+            static std::unique_ptr<const KatanaOps::SharedGroupAttribute>
+                s_sharpMeshes[MeshDetail::kMaxSubdivisions + 1];
+            std::call_once(s_flags[level], [level]()
+            {
+                s_sharpMeshes[level].reset(new KatanaOps::SharedGroupAttribute(
+                    buildMeshGeometry(level, 0.0)));
+            });
+            return *s_sharpMeshes[level];
+        }
+
+        // Most recently used first, along with the position of each mesh
+        typedef std::pair<int, double> MeshKey;
+        typedef std::list<std::pair<MeshKey,
+                                    KatanaOps::SharedGroupAttribute> >
+            MeshList;
+        typedef std::map<MeshKey, MeshList::iterator> MeshMap;
+        static std::mutex s_mutex;
+        static MeshList s_meshList;
+        static MeshMap s_meshes;
+
+        const MeshKey key(level, roundness);
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            MeshMap::const_iterator it = s_meshes.find(key);
+            if (it != s_meshes.end())
+            {
+                s_meshList.splice(s_meshList.begin(), s_meshList, it->second);
+                return it->second->second;
+            }
+        }
+
+        // Build outside of the lock, so that cooks needing different meshes
+        // don't wait for each other. Concurrent cooks may build the same
+        // mesh, only the first one is kept
+        const KatanaOps::SharedGroupAttribute meshAttr(
+            buildMeshGeometry(level, roundness));
+        std::lock_guard<std::mutex> lock(s_mutex);
+        MeshMap::const_iterator it = s_meshes.find(key);
+        if (it != s_meshes.end())
+        {
+            return it->second->second;
+        }
+        s_meshList.push_front(std::make_pair(key, meshAttr));
+        s_meshes[key] = s_meshList.begin();
+        if (s_meshList.size() > kMaxCachedMeshes)
+        {
+            s_meshes.erase(s_meshList.back().first);
+            s_meshList.pop_back();
+        }
+        return meshAttr;
+    }
+
+    /**
+     * Builds and returns a group attribute representing the cube geometry
+     * of the given subdivision level and roundness, see buildMesh() and
+     * topology::MeshTables
+     */
+    static FnAttribute::GroupAttribute buildMeshGeometry(int level,
+                                                         double roundness)
+    {
+        int64_t numPoints = 0;
+        int64_t numFaces = 0;
+        getMeshSizes(level, numPoints, numFaces);
+
+        // The sharp meshes of the common levels are generated at compile
+        // time, and referenced instead of being built
+        topology::CompiledTables tables;
+        if (roundness <= 0.0 && topology::getCompiledTables(level, tables))
+        {
+            FnAttribute::GroupBuilder gb;
+
+            FnAttribute::GroupBuilder gbPoint;
+            gbPoint.set("P",
+                        KatanaOps::wrapStaticData<FnAttribute::FloatAttribute>(
+                            tables.points, numPoints * 3, 3));
+            gb.set("point", gbPoint.build());
+
+            FnAttribute::GroupBuilder gbPoly;
+            gbPoly.set("vertexList",
+                       KatanaOps::wrapStaticData<FnAttribute::IntAttribute>(
+                           tables.vertexList, numFaces * 4, 1));
+            gbPoly.set("startIndex",
+                       KatanaOps::wrapStaticData<FnAttribute::IntAttribute>(
+                           tables.startIndex, numFaces + 1, 1));
+            gb.set("poly", gbPoly.build());
+
+            return gb.build();
+        }
+
+        KatanaOps::CookArena arena;
+        float *points = arena.allocate<float>(numPoints * 3);
+        int *vertexList = arena.allocate<int>(numFaces * 4);
+        int *startIndex = arena.allocate<int>(numFaces + 1);
+        buildMesh(level, roundness, points, vertexList, startIndex);
+
+        FnAttribute::GroupBuilder gb;
+
+        FnAttribute::GroupBuilder gbPoint;
+        gbPoint.set("P", arena.makeAttribute<FnAttribute::FloatAttribute>(
+            points, numPoints * 3, 3));
+        gb.set("point", gbPoint.build());
+
+        FnAttribute::GroupBuilder gbPoly;
+        gbPoly.set("vertexList",
+                   arena.makeAttribute<FnAttribute::IntAttribute>(
+                       vertexList, numFaces * 4, 1));
+        gbPoly.set("startIndex",
+                   arena.makeAttribute<FnAttribute::IntAttribute>(
+                       startIndex, numFaces + 1, 1));
+        gb.set("poly", gbPoly.build());
+
+        return gb.build();
+    }
+
+    /**
+     * Builds and returns a group attribute representing the transform of the
+     * i-th cube, including rotation values
+     */
+    static FnAttribute::Attribute buildTransform(int index, double rotation,
+                                                 const Placement &placement)
+    {
+        FnKat::GroupBuilder gb;
+
+        double translate[3];
+        getCubeTranslate(index, placement, translate);
+        gb.set("translate", FnKat::DoubleAttribute(translate, 3, 3));
+
+        const double rxValues[] = { rotation,  1.0, 0.0, 0.0 };
+        gb.set("rotateX", FnKat::DoubleAttribute(rxValues, 4, 4));
+        gb.set("rotateY", getCachedRotateY().get());
+        gb.set("rotateZ", getCachedRotateZ().get());
+
+        const double scale = getCubeScale(index, placement);
+        const double scaleValues[] = { scale, scale, scale };
+        gb.set("scale", FnKat::DoubleAttribute(scaleValues, 3, 3));
+
+        gb.setGroupInherit(false);
+        return gb.build();
+    }
+
+    /**
+     * Builds and returns a group attribute representing the transform of the
+     * i-th cube as a single 4x4 matrix, equivalent to the components set by
+     * buildTransform(), so that consumers don't need to compose them
+     */
+    static FnAttribute::Attribute buildTransformMatrix(
+        int index, double rotation, const Placement &placement)
+    {
+        double matrix[16];
+        getCubeMatrix(index, rotation, placement, matrix);
+        return FnAttribute::GroupAttribute(
+            "matrix", FnAttribute::DoubleAttribute(matrix, 16, 16), false);
+    }
+
+    /**
+     * Builds and returns a group attribute representing the transform of the
+     * i-th cube at each of the given time samples, by components, as
+     * buildTransform() does, or by matrix. All the samples are computed in a
+     * single pass, see getCubeMotion().
+     */
+    static FnAttribute::Attribute buildSampledTransform(
+        int index, const Placement &placement, const MotionSamples &motion,
+        bool xformMatrix)
+    {
+        const int numberOfSamples = motion.numberOfSamples;
+        float times[MotionSamples::kMaxSamples];
+        for (int sample = 0; sample < numberOfSamples; ++sample)
+        {
+            times[sample] = motion.getSampleTime(sample);
+        }
+
+        double translate[MotionSamples::kMaxSamples * 3];
+        double rotation[MotionSamples::kMaxSamples];
+        getCubeMotion(index, placement, times, numberOfSamples, translate,
+                      rotation);
+        const double scale = getCubeScale(index, placement);
+
+        if (xformMatrix)
+        {
+            double matrices[MotionSamples::kMaxSamples * 16];
+            const double *matrixSamples[MotionSamples::kMaxSamples];
+            for (int sample = 0; sample < numberOfSamples; ++sample)
+            {
+                setCubeMatrix(translate + sample * 3, scale, rotation[sample],
+                              matrices + sample * 16);
+                matrixSamples[sample] = matrices + sample * 16;
+            }
+            return FnAttribute::GroupAttribute(
+                "matrix", FnAttribute::DoubleAttribute(
+                    times, numberOfSamples, matrixSamples, 16, 16),
+                false);
+        }
+
+        double rotateX[MotionSamples::kMaxSamples * 4];
+        const double *translateSamples[MotionSamples::kMaxSamples];
+        const double *rotateXSamples[MotionSamples::kMaxSamples];
+        for (int sample = 0; sample < numberOfSamples; ++sample)
+        {
+            double *rx = rotateX + sample * 4;
+            rx[0] = rotation[sample];
+            rx[1] = 1.0;
+            rx[2] = 0.0;
+            rx[3] = 0.0;
+            translateSamples[sample] = translate + sample * 3;
+            rotateXSamples[sample] = rx;
+        }
+
+        FnKat::GroupBuilder gb;
+        gb.set("translate", FnKat::DoubleAttribute(
+            times, numberOfSamples, translateSamples, 3, 3));
+        gb.set("rotateX", FnKat::DoubleAttribute(
+            times, numberOfSamples, rotateXSamples, 4, 4));
+        gb.set("rotateY", getCachedRotateY().get());
+        gb.set("rotateZ", getCachedRotateZ().get());
+
+        const double scaleValues[] = { scale, scale, scale };
+        gb.set("scale", FnKat::DoubleAttribute(scaleValues, 3, 3));
+
+        gb.setGroupInherit(false);
+        return gb.build();
+    }
+
+    /**
+     * Returns the 'rotateY' transform component, which is the same for all
+     * the cubes and therefore only built, and hashed, once
+     */
+    static const KatanaOps::SharedDoubleAttribute& getCachedRotateY()
+    {
+        static const double s_values[] = { 0.0, 0.0, 1.0, 0.0 };
+        static const KatanaOps::SharedDoubleAttribute s_rotateY(
+            FnAttribute::DoubleAttribute(s_values, 4, 4));
+        return s_rotateY;
+    }
+
+    /**
+     * Returns the 'rotateZ' transform component, which is the same for all
+     * the cubes and therefore only built, and hashed, once
+     */
+    static const KatanaOps::SharedDoubleAttribute& getCachedRotateZ()
+    {
+        static const double s_values[] = { 0.0, 0.0, 0.0, 1.0 };
+        static const KatanaOps::SharedDoubleAttribute s_rotateZ(
+            FnAttribute::DoubleAttribute(s_values, 4, 4));
+        return s_rotateZ;
+    }
+
+    /**
+     * Returns the 'geometry.arbitrary' group attribute of the leaf location
+     * of the i-th cube, holding the given primvars
+     */
+    static FnAttribute::GroupAttribute buildLeafPrimvars(
+        int index, const Placement &placement, const Primvars &primvars)
+    {
+        FnAttribute::GroupBuilder gb;
+        if (primvars.displayColor)
+        {
+            float color[3];
+            getCubeColor(index, placement, color);
+            gb.set("displayColor", buildPrimvar(
+                getCachedColorType().get(),
+                FnAttribute::FloatAttribute(color, 3, 3)));
+        }
+        if (primvars.instanceId)
+        {
+            gb.set("instanceId", buildPrimvar(
+                getCachedIdType().get(), FnAttribute::IntAttribute(index)));
+        }
+        return gb.build();
+    }
+
+    /**
+     * Returns the 'instance.arbitrary' group attribute of an instance array
+     * location holding all the cubes, with one array per primvar, of one
+     * value, or tuple, per cube in index order
+     */
+    static FnAttribute::GroupAttribute buildInstancePrimvars(
+        const Placement &placement, const Primvars &primvars)
+    {
+        const size_t count = static_cast<size_t>(placement.numberOfCubes);
+        const int64_t numValues = static_cast<int64_t>(count);
+        KatanaOps::CookArena arena;
+
+        FnAttribute::GroupBuilder gb;
+        if (primvars.displayColor)
+        {
+            float *colors = arena.allocate<float>(count * 3);
+            KatanaOps::parallelFor(0, count, kParallelGrainSize,
+                [&](size_t begin, size_t end)
+                {
+                    fillCubeColors(begin, end, placement, colors + begin * 3);
+                });
+            gb.set("displayColor", buildPrimvar(
+                getCachedColorType().get(),
+                arena.makeAttribute<FnAttribute::FloatAttribute>(
+                    colors, numValues * 3, 3)));
+        }
+        if (primvars.instanceId)
+        {
+            int *ids = arena.allocate<int>(count);
+            KatanaOps::parallelFor(0, count, kParallelGrainSize,
+                [&](size_t begin, size_t end)
+                {
+                    fillCubeIds(begin, end, ids + begin);
+                });
+            gb.set("instanceId", buildPrimvar(
+                getCachedIdType().get(),
+                arena.makeAttribute<FnAttribute::IntAttribute>(
+                    ids, numValues, 1)));
+        }
+        return gb.build();
+    }
+
+    /**
+     * Returns the group attribute describing a primvar of the given input
+     * type and values, one value, or tuple, per cube
+     */
+    static FnAttribute::GroupAttribute buildPrimvar(
+        const FnAttribute::StringAttribute &inputTypeAttr,
+        const FnAttribute::Attribute &valueAttr)
+    {
+        return FnAttribute::GroupAttribute(
+            "scope", getCachedPrimvarScope().get(),
+            "inputType", inputTypeAttr,
+            "value", valueAttr,
+            false);
+    }
+
+    /**
+     * Returns the 'scope' attribute of the primvars, which are constant
+     * over each cube
+     */
+    static const KatanaOps::SharedStringAttribute& getCachedPrimvarScope()
+    {
+        static const KatanaOps::SharedStringAttribute s_scope(
+            FnAttribute::StringAttribute("primitive"));
+        return s_scope;
+    }
+
+    /**
+     * Returns the 'inputType' attribute of the 'displayColor' primvar
+     */
+    static const KatanaOps::SharedStringAttribute& getCachedColorType()
+    {
+        static const KatanaOps::SharedStringAttribute s_type(
+            FnAttribute::StringAttribute("color3"));
+        return s_type;
+    }
+
+    /**
+     * Returns the 'inputType' attribute of the 'instanceId' primvar
+     */
+    static const KatanaOps::SharedStringAttribute& getCachedIdType()
+    {
+        static const KatanaOps::SharedStringAttribute s_type(
+            FnAttribute::StringAttribute("int"));
+        return s_type;
+    }
+
+    /**
+     * Builds and returns the 'geometry' group attribute of an instance array
+     * location holding all the cubes, each one being transformed as
+     * buildTransform() would do for the corresponding leaf location, either
+     * by components or, if requested, by matrix, at each of the given time
+     * samples, and indexing the instance source of its LOD level
+     */
+    static FnAttribute::Attribute buildInstanceArray(
+        const FnAttribute::StringAttribute &instanceSourceAttr,
+        const Placement &placement, const MotionSamples &motion,
+        const MeshDetail &detail, bool xformMatrix)
+    {
+        const size_t count = static_cast<size_t>(placement.numberOfCubes);
+        const int64_t numValues = static_cast<int64_t>(count);
+
+        // The arrays are written in place into pooled buffers that the
+        // attributes take over, instead of being copied
+        KatanaOps::CookArena arena;
+
+        // Instances index the instance source of their LOD level
+        int *instanceIndex = arena.allocate<int>(count);
+        if (detail.getNumberOfLevels() > 1)
+        {
+            KatanaOps::parallelFor(0, count, kParallelGrainSize,
+                [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        instanceIndex[i] = getCubeLevel(
+                            static_cast<int>(i), placement, detail);
+                    }
+                });
+        }
+        else
+        {
+            std::fill(instanceIndex, instanceIndex + count, 0);
+        }
+
+        FnAttribute::GroupBuilder gb;
+        gb.set("instanceSource", instanceSourceAttr);
+        gb.set("instanceIndex",
+               arena.makeAttribute<FnAttribute::IntAttribute>(
+                   instanceIndex, numValues, 1));
+
+        // The transforms are written by batch kernels, vectorized for the
+        // instruction set of the running CPU, one time sample after the
+        // other into the same buffers, each kernel call being split into
+        // chunks run in parallel
+        const InstanceKernels &kernels = getBestInstanceKernels();
+        const int numberOfSamples = motion.numberOfSamples;
+        const size_t numSamples = static_cast<size_t>(numberOfSamples);
+        float times[MotionSamples::kMaxSamples];
+        for (int sample = 0; sample < numberOfSamples; ++sample)
+        {
+            times[sample] = motion.getSampleTime(sample);
+        }
+
+        if (xformMatrix)
+        {
+            double *matrix = arena.allocate<double>(count * 16 * numSamples);
+            for (size_t sample = 0; sample < numSamples; ++sample)
+            {
+                Placement samplePlacement = placement;
+                samplePlacement.time += times[sample];
+                double *sampleMatrix = matrix + count * 16 * sample;
+                KatanaOps::parallelFor(0, count, kParallelGrainSize,
+                    [&](size_t begin, size_t end)
+                    {
+                        kernels.fillMatrices(samplePlacement, begin, end,
+                                             sampleMatrix + begin * 16);
+                    });
+            }
+
+            gb.set("instanceMatrix",
+                   arena.makeAttribute<FnAttribute::DoubleAttribute>(
+                       times, numberOfSamples, matrix, numValues * 16, 16));
+            return gb.build();
+        }
+
+        // Only the translation and the rotation around X vary over time,
+        // the other components are written again, identical, by each sample
+        double *translate = arena.allocate<double>(count * 3 * numSamples);
+        double *rotateX = arena.allocate<double>(count * 4 * numSamples);
+        double *rotateY = arena.allocate<double>(count * 4);
+        double *rotateZ = arena.allocate<double>(count * 4);
+        double *scale = arena.allocate<double>(count * 3);
+
+        for (size_t sample = 0; sample < numSamples; ++sample)
+        {
+            Placement samplePlacement = placement;
+            samplePlacement.time += times[sample];
+            double *sampleTranslate = translate + count * 3 * sample;
+            double *sampleRotateX = rotateX + count * 4 * sample;
+            KatanaOps::parallelFor(0, count, kParallelGrainSize,
+                [&](size_t begin, size_t end)
+                {
+                    kernels.fillTransforms(samplePlacement, begin, end,
+                                           sampleTranslate + begin * 3,
+                                           sampleRotateX + begin * 4,
+                                           rotateY + begin * 4,
+                                           rotateZ + begin * 4,
+                                           scale + begin * 3);
+                });
+        }
+
+        gb.set("instanceTranslate",
+               arena.makeAttribute<FnAttribute::DoubleAttribute>(
+                   times, numberOfSamples, translate, numValues * 3, 3));
+        gb.set("instanceRotateX",
+               arena.makeAttribute<FnAttribute::DoubleAttribute>(
+                   times, numberOfSamples, rotateX, numValues * 4, 4));
+        gb.set("instanceRotateY",
+               arena.makeAttribute<FnAttribute::DoubleAttribute>(
+                   rotateY, numValues * 4, 4));
+        gb.set("instanceRotateZ",
+               arena.makeAttribute<FnAttribute::DoubleAttribute>(
+                   rotateZ, numValues * 4, 4));
+        gb.set("instanceScale",
+               arena.makeAttribute<FnAttribute::DoubleAttribute>(
+                   scale, numValues * 3, 3));
+        return gb.build();
+    }
+
+    /**
+     * Replaces whatever follows the first 'prefixLength' characters of the
+     * given name with the decimal digits of the given index, reusing the
+     * string storage instead of going through a locale-aware stream
+     */
+    static void setIndexedName(std::string &name, size_t prefixLength,
+                               int index)
+    {
+        char digits[16];
+        const std::to_chars_result result = std::to_chars(
+            digits, digits + sizeof(digits), static_cast<unsigned>(index));
+        name.resize(prefixLength);
+        name.append(digits, result.ptr);
+    }
+
+    /**
+     * Returns the first value of the given string attribute, or the given
+     * default value if it has none, as a view of the attribute's own data,
+     * valid for as long as the attribute is held, instead of a copy
+     */
+    static std::string_view getStringValue(
+        const FnAttribute::StringAttribute &attr,
+        std::string_view defaultValue)
+    {
+        if (attr.getNumberOfValues() == 0)
+        {
+            return defaultValue;
+        }
+        return attr.getNearestSample(0.0f)[0];
+    }
+
+    /**
+     * Builds and returns the group attribute, shared by all the locations
+     * generated from the given 'a' Op argument, holding the values the cube
+     * transforms and meshes are derived from.
+     *
+     * Only the values differing from their defaults are stored, so that
+     * the arguments of the cubes, and of the bucket groups, that a change of
+     * the node parameters doesn't affect stay the same, and keep hitting the
+     * Geolib cache. The rotation is stored as a step from one cube to the
+     * next, 'maxRotation' divided by the number of cubes: it is the only
+     * value depending on the number of cubes, which, when 'maxRotation' is
+     * non-zero, changes 'params', and so the arguments of every leaf and
+     * bucket group, along with it. Without rotation, none of them depend on
+     * the number of cubes.
+     */
+    static FnAttribute::GroupAttribute buildParams(
+        const FnAttribute::GroupAttribute &aGrpAttr)
+    {
+        FnAttribute::IntAttribute numberOfCubesAttr =
+            aGrpAttr.getChildByName("numberOfCubes");
+        FnAttribute::DoubleAttribute maxRotationAttr =
+            aGrpAttr.getChildByName("maxRotation");
+        FnAttribute::IntAttribute xformMatrixAttr =
+            aGrpAttr.getChildByName("xformMatrix");
+        FnAttribute::StringAttribute placementAttr =
+            aGrpAttr.getChildByName("placement");
+        FnAttribute::IntAttribute seedAttr =
+            aGrpAttr.getChildByName("seed");
+        FnAttribute::DoubleAttribute scatterSizeAttr =
+            aGrpAttr.getChildByName("scatterSize");
+        FnAttribute::DoubleAttribute scatterScaleAttr =
+            aGrpAttr.getChildByName("scatterScale");
+        FnAttribute::StringAttribute pointFileAttr =
+            aGrpAttr.getChildByName("pointFile");
+        FnAttribute::DoubleAttribute pointFileStampAttr =
+            aGrpAttr.getChildByName("pointFileStamp");
+        FnAttribute::IntAttribute subdivisionsAttr =
+            aGrpAttr.getChildByName("subdivisions");
+        FnAttribute::DoubleAttribute roundnessAttr =
+            aGrpAttr.getChildByName("roundness");
+        FnAttribute::DoubleAttribute lodDistanceAttr =
+            aGrpAttr.getChildByName("lodDistance");
+        FnAttribute::DoubleAttribute lodCenterAttr =
+            aGrpAttr.getChildByName("lodCenter");
+        FnAttribute::DoubleAttribute rotationSpeedAttr =
+            aGrpAttr.getChildByName("rotationSpeed");
+        FnAttribute::DoubleAttribute translationSpeedAttr =
+            aGrpAttr.getChildByName("translationSpeed");
+        FnAttribute::DoubleAttribute frameAttr =
+            aGrpAttr.getChildByName("frame");
+        FnAttribute::IntAttribute motionSamplesAttr =
+            aGrpAttr.getChildByName("motionSamples");
+        FnAttribute::DoubleAttribute shutterOpenAttr =
+            aGrpAttr.getChildByName("shutterOpen");
+        FnAttribute::DoubleAttribute shutterCloseAttr =
+            aGrpAttr.getChildByName("shutterClose");
+        FnAttribute::IntAttribute displayColorAttr =
+            aGrpAttr.getChildByName("displayColor");
+        FnAttribute::IntAttribute instanceIdAttr =
+            aGrpAttr.getChildByName("instanceId");
+
+        const Placement defaults;
+        FnAttribute::GroupBuilder gb;
+
+        const int numberOfCubes = numberOfCubesAttr.getValue(0, false);
+        const double maxRotation = maxRotationAttr.getValue(0.0, false);
+        if (numberOfCubes > 0 && maxRotation != 0.0)
+        {
+            gb.set("rotationStep",
+                   FnAttribute::DoubleAttribute(maxRotation / numberOfCubes));
+        }
+
+        if (xformMatrixAttr.getValue(0, false) != 0)
+        {
+            gb.set("xformMatrix", FnAttribute::IntAttribute(1));
+        }
+
+        const std::string placement = placementAttr.getValue("line", false);
+        if (placement == "points")
+        {
+            gb.set("placement", FnAttribute::StringAttribute(placement));
+            gb.set("pointFile", FnAttribute::StringAttribute(
+                pointFileAttr.getValue(std::string(), false)));
+            gb.set("pointFileStamp", FnAttribute::DoubleAttribute(
+                pointFileStampAttr.getValue(0.0, false)));
+            gb.set("scatterScale", FnAttribute::DoubleAttribute(
+                scatterScaleAttr.getValue(defaults.scatterScale, false)));
+        }
+        else if (placement != "line")
+        {
+            gb.set("placement", FnAttribute::StringAttribute(placement));
+            gb.set("seed", FnAttribute::IntAttribute(
+                seedAttr.getValue(0, false)));
+            gb.set("scatterSize", FnAttribute::DoubleAttribute(
+                scatterSizeAttr.getValue(defaults.scatterSize, false)));
+            gb.set("scatterScale", FnAttribute::DoubleAttribute(
+                scatterScaleAttr.getValue(defaults.scatterScale, false)));
+        }
+
+        const int subdivisions = std::min(
+            std::max(subdivisionsAttr.getValue(0, false), 0),
+            static_cast<int>(MeshDetail::kMaxSubdivisions));
+        const double lodDistance = lodDistanceAttr.getValue(0.0, false);
+        if (subdivisions > 0)
+        {
+            gb.set("subdivisions", FnAttribute::IntAttribute(subdivisions));
+            if (lodDistance > 0.0)
+            {
+                double lodCenter[3] = { 0.0, 0.0, 0.0 };
+                if (lodCenterAttr.getNumberOfValues() == 3)
+                {
+                    FnAttribute::DoubleConstVector values =
+                        lodCenterAttr.getNearestSample(0.0f);
+                    std::copy(values.begin(), values.end(), lodCenter);
+                }
+                gb.set("lodDistance",
+                       FnAttribute::DoubleAttribute(lodDistance));
+                gb.set("lodCenter",
+                       FnAttribute::DoubleAttribute(lodCenter, 3, 3));
+            }
+        }
+
+        const double roundness =
+            std::min(std::max(roundnessAttr.getValue(0.0, false), 0.0), 1.0);
+        if (roundness > 0.0)
+        {
+            gb.set("roundness", FnAttribute::DoubleAttribute(roundness));
+        }
+
+        if (displayColorAttr.getValue(0, false) != 0)
+        {
+            gb.set("displayColor", FnAttribute::IntAttribute(1));
+        }
+        if (instanceIdAttr.getValue(0, false) != 0)
+        {
+            gb.set("instanceId", FnAttribute::IntAttribute(1));
+        }
+
+        // The frame, and the motion samples, only matter to moving cubes,
+        // static ones keeping the same arguments from one frame to the next
+        Placement motion;
+        motion.rotationSpeed = rotationSpeedAttr.getValue(0.0, false);
+        if (translationSpeedAttr.getNumberOfValues() == 3)
+        {
+            FnAttribute::DoubleConstVector values =
+                translationSpeedAttr.getNearestSample(0.0f);
+            std::copy(values.begin(), values.end(), motion.translationSpeed);
+        }
+        if (motion.rotationSpeed != 0.0 || motion.hasTranslationMotion())
+        {
+            gb.set("frame", FnAttribute::DoubleAttribute(
+                frameAttr.getValue(0.0, false)));
+            if (motion.rotationSpeed != 0.0)
+            {
+                gb.set("rotationSpeed",
+                       FnAttribute::DoubleAttribute(motion.rotationSpeed));
+            }
+            if (motion.hasTranslationMotion())
+            {
+                gb.set("translationSpeed", FnAttribute::DoubleAttribute(
+                    motion.translationSpeed, 3, 3));
+            }
+
+            const int motionSamples = std::min(
+                std::max(motionSamplesAttr.getValue(1, false), 1),
+                static_cast<int>(MotionSamples::kMaxSamples));
+            if (motionSamples > 1)
+            {
+                gb.set("motionSamples",
+                       FnAttribute::IntAttribute(motionSamples));
+                gb.set("shutterOpen", FnAttribute::DoubleAttribute(
+                    shutterOpenAttr.getValue(0.0, false)));
+                gb.set("shutterClose", FnAttribute::DoubleAttribute(
+                    shutterCloseAttr.getValue(0.0, false)));
+            }
+        }
+
+        return gb.build();
+    }
+
+    /**
+     * Returns the placement described by the given 'params' Op argument, as
+     * built by buildParams(), which doesn't hold the number of cubes. The
+     * points placement references the points of 'pointFile', which must be
+     * held while the placement is used (it is left null if the point file
+     * can't be read).
+     */
+    static Placement getPlacement(
+        const FnAttribute::GroupAttribute &paramsAttr, PointFilePtr &pointFile)
+    {
+        FnAttribute::DoubleAttribute rotationStepAttr =
+            paramsAttr.getChildByName("rotationStep");
+        FnAttribute::StringAttribute placementAttr =
+            paramsAttr.getChildByName("placement");
+        FnAttribute::IntAttribute seedAttr =
+            paramsAttr.getChildByName("seed");
+        FnAttribute::DoubleAttribute scatterSizeAttr =
+            paramsAttr.getChildByName("scatterSize");
+        FnAttribute::DoubleAttribute scatterScaleAttr =
+            paramsAttr.getChildByName("scatterScale");
+        FnAttribute::DoubleAttribute frameAttr =
+            paramsAttr.getChildByName("frame");
+        FnAttribute::DoubleAttribute rotationSpeedAttr =
+            paramsAttr.getChildByName("rotationSpeed");
+        FnAttribute::DoubleAttribute translationSpeedAttr =
+            paramsAttr.getChildByName("translationSpeed");
+
+        Placement placement;
+        getPlacementMode(getStringValue(placementAttr, "line"),
+                         placement.mode);
+        placement.rotationStep = rotationStepAttr.getValue(0.0, false);
+        placement.seed = static_cast<uint32_t>(seedAttr.getValue(0, false));
+        placement.scatterSize =
+            scatterSizeAttr.getValue(placement.scatterSize, false);
+        placement.scatterScale =
+            scatterScaleAttr.getValue(placement.scatterScale, false);
+        if (placement.mode == Placement::kModePoints)
+        {
+            std::string error;
+            pointFile = getPlacementPointFile(paramsAttr, error);
+            placement.points = pointFile ? &pointFile->points : nullptr;
+        }
+        placement.time = frameAttr.getValue(0.0, false);
+        placement.rotationSpeed = rotationSpeedAttr.getValue(0.0, false);
+        if (translationSpeedAttr.getNumberOfValues() == 3)
+        {
+            FnAttribute::DoubleConstVector values =
+                translationSpeedAttr.getNearestSample(0.0f);
+            std::copy(values.begin(), values.end(),
+                      placement.translationSpeed);
+        }
+        return placement;
+    }
+
+    /**
+     * Returns the point file given by the 'params' Op argument, as built by
+     * buildParams(), or null, setting 'error', if it can't be read
+     */
+    static PointFilePtr getPlacementPointFile(
+        const FnAttribute::GroupAttribute &paramsAttr, std::string &error)
+    {
+        FnAttribute::StringAttribute pointFileAttr =
+            paramsAttr.getChildByName("pointFile");
+        return getPointFile(pointFileAttr.getValue(std::string(), false),
+                            error);
+    }
+
+    /**
+     * Returns the motion samples described by the given 'params' Op
+     * argument, as built by buildParams()
+     */
+    static MotionSamples getMotionSamples(
+        const FnAttribute::GroupAttribute &paramsAttr)
+    {
+        FnAttribute::IntAttribute motionSamplesAttr =
+            paramsAttr.getChildByName("motionSamples");
+        FnAttribute::DoubleAttribute shutterOpenAttr =
+            paramsAttr.getChildByName("shutterOpen");
+        FnAttribute::DoubleAttribute shutterCloseAttr =
+            paramsAttr.getChildByName("shutterClose");
+
+        MotionSamples motion;
+        motion.numberOfSamples = std::min(
+            std::max(motionSamplesAttr.getValue(1, false), 1),
+            static_cast<int>(MotionSamples::kMaxSamples));
+        motion.shutterOpen = shutterOpenAttr.getValue(0.0, false);
+        motion.shutterClose = shutterCloseAttr.getValue(0.0, false);
+        return motion;
+    }
+
+    /**
+     * Returns the primvars selected by the given 'params' Op argument, as
+     * built by buildParams()
+     */
+    static Primvars getPrimvars(const FnAttribute::GroupAttribute &paramsAttr)
+    {
+        FnAttribute::IntAttribute displayColorAttr =
+            paramsAttr.getChildByName("displayColor");
+        FnAttribute::IntAttribute instanceIdAttr =
+            paramsAttr.getChildByName("instanceId");
+
+        Primvars primvars;
+        primvars.displayColor = displayColorAttr.getValue(0, false) != 0;
+        primvars.instanceId = instanceIdAttr.getValue(0, false) != 0;
+        return primvars;
+    }
+
+    /**
+     * Returns the mesh detail described by the given 'params' Op argument,
+     * as built by buildParams()
+     */
+    static MeshDetail getMeshDetail(
+        const FnAttribute::GroupAttribute &paramsAttr)
+    {
+        FnAttribute::IntAttribute subdivisionsAttr =
+            paramsAttr.getChildByName("subdivisions");
+        FnAttribute::DoubleAttribute roundnessAttr =
+            paramsAttr.getChildByName("roundness");
+        FnAttribute::DoubleAttribute lodDistanceAttr =
+            paramsAttr.getChildByName("lodDistance");
+        FnAttribute::DoubleAttribute lodCenterAttr =
+            paramsAttr.getChildByName("lodCenter");
+
+        MeshDetail detail;
+        detail.subdivisions = subdivisionsAttr.getValue(0, false);
+        detail.roundness = roundnessAttr.getValue(0.0, false);
+        detail.lodDistance = lodDistanceAttr.getValue(0.0, false);
+        if (lodCenterAttr.getNumberOfValues() == 3)
+        {
+            FnAttribute::DoubleConstVector values =
+                lodCenterAttr.getNearestSample(0.0f);
+            std::copy(values.begin(), values.end(), detail.lodCenter);
+        }
+        return detail;
+    }
+};
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKEROP_H
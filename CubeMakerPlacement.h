@@ -0,0 +1,504 @@
+#ifndef KATANAOPS_CUBEMAKERPLACEMENT_H
+#define KATANAOPS_CUBEMAKERPLACEMENT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+
+namespace CubeMaker
+{
+
+/**
+ * PointSet
+ *
+ * Positions and scales of the cubes of the 'points' placement, as records
+ * of 4 floats (x, y, z and scale), along with the bounding box of the
+ * positions and the largest absolute scale. See CubeMakerPoints.h for how
+ * they are read from files.
+ */
+struct PointSet
+{
+    const float *records;
+    int64_t numberOfPoints;
+    double bound[6];
+    double maxScale;
+};
+
+/**
+ * Placement
+ *
+ * Describes how the cubes are distributed in space. The functions below
+ * compute the transform of any cube from its index alone, in constant time
+ * and without any shared state, so that cubes can be generated in any order
+ * and concurrently.
+ *
+ * This header only depends on the standard library, so that the same code
+ * can be used outside of Katana.
+ */
+struct Placement
+{
+    enum Mode
+    {
+        /// Cubes of increasing size on the X axis (the original layout)
+        kModeLine = 0,
+        /// Cubes scattered uniformly in a box centred on the origin
+        kModeBox,
+        /// Cubes scattered uniformly on a sphere centred on the origin
+        kModeSphere,
+        /// Cubes at the positions, and scaled by the scales, of a point set
+        kModePoints
+    };
+
+    Placement()
+        : mode(kModeLine),
+          numberOfCubes(1),
+          rotationStep(0.0),
+          seed(0),
+          scatterSize(10.0),
+          scatterScale(1.0),
+          points(nullptr),
+          time(0.0),
+          rotationSpeed(0.0)
+    {
+        translationSpeed[0] = translationSpeed[1] = translationSpeed[2] = 0.0;
+    }
+
+    /**
+     * Returns whether the cubes move over time
+     */
+    bool hasTranslationMotion() const
+    {
+        return translationSpeed[0] != 0.0 || translationSpeed[1] != 0.0 ||
+            translationSpeed[2] != 0.0;
+    }
+
+    Mode mode;
+    int numberOfCubes;
+    /// Rotation, in degrees around the X axis, added from one cube to the
+    /// next
+    double rotationStep;
+
+    /// Seed of the random numbers used by the scatter modes
+    uint32_t seed;
+    /// Edge length of the box, or diameter of the sphere, cubes are
+    /// scattered in or on
+    double scatterSize;
+    /// Uniform scale of the cubes in the scatter modes, and of the point
+    /// scales in the points mode
+    double scatterScale;
+    /// Points of the points mode, which must outlive the placement. Cubes
+    /// past the last point are placed at the origin.
+    const PointSet *points;
+
+    /// Frame the transforms are evaluated at, the cubes turning and moving
+    /// at the speeds below from where they are at frame 0
+    double time;
+    /// Rotation, in degrees around the X axis, added per frame
+    double rotationSpeed;
+    /// Translation added per frame
+    double translationSpeed[3];
+};
+
+/**
+ * Sets the placement mode matching the given 'placement' argument value,
+ * returns false if the value isn't supported
+ */
+inline bool getPlacementMode(std::string_view name, Placement::Mode &mode)
+{
+    if (name == "line")
+    {
+        mode = Placement::kModeLine;
+    }
+    else if (name == "box")
+    {
+        mode = Placement::kModeBox;
+    }
+    else if (name == "sphere")
+    {
+        mode = Placement::kModeSphere;
+    }
+    else if (name == "points")
+    {
+        mode = Placement::kModePoints;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * MotionSamples
+ *
+ * Describes the times, relative to the frame, the cube transforms are
+ * sampled at for motion blur: 'numberOfSamples' evenly spaced times from
+ * 'shutterOpen' to 'shutterClose', or the frame alone for a single sample.
+ */
+struct MotionSamples
+{
+    enum { kMaxSamples = 16 };
+
+    MotionSamples() : numberOfSamples(1), shutterOpen(0.0), shutterClose(0.0)
+    {
+    }
+
+    /**
+     * Returns the time of the given sample, relative to the frame
+     */
+    float getSampleTime(int sample) const
+    {
+        if (numberOfSamples <= 1)
+        {
+            return 0.0f;
+        }
+        return static_cast<float>(
+            shutterOpen + (shutterClose - shutterOpen) * sample /
+            (numberOfSamples - 1));
+    }
+
+    int numberOfSamples;
+    double shutterOpen;
+    double shutterClose;
+};
+
+const double g_degreesToRadians = 3.14159265358979323846 / 180.0;
+
+/**
+ * Philox4x32-10 counter-based random number generator.
+ *
+ * Returns, in 'result', four 32-bit random numbers which are a function of
+ * the given counter and key only. See "Parallel Random Numbers: As Easy as
+ * 1, 2, 3", Salmon et al., SC 2011.
+ */
+inline void philox4x32(const uint32_t counter[4], const uint32_t key[2],
+                       uint32_t result[4])
+{
+    const uint32_t kMultiplier0 = 0xD2511F53u;
+    const uint32_t kMultiplier1 = 0xCD9E8D57u;
+    const uint32_t kWeyl0 = 0x9E3779B9u;
+    const uint32_t kWeyl1 = 0xBB67AE85u;
+
+    uint32_t c0 = counter[0], c1 = counter[1];
+    uint32_t c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; ++round)
+    {
+        const uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * c0;
+        const uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * c2;
+        const uint32_t hi0 = static_cast<uint32_t>(product0 >> 32);
+        const uint32_t lo0 = static_cast<uint32_t>(product0);
+        const uint32_t hi1 = static_cast<uint32_t>(product1 >> 32);
+        const uint32_t lo1 = static_cast<uint32_t>(product1);
+
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+
+        k0 += kWeyl0;
+        k1 += kWeyl1;
+    }
+
+    result[0] = c0;
+    result[1] = c1;
+    result[2] = c2;
+    result[3] = c3;
+}
+
+/**
+ * Writes four uniformly distributed numbers in [0, 1) for the given cube
+ * index, seed and stream. Different streams give independent numbers for the
+ * same cube.
+ */
+inline void getCubeRandoms(int index, uint32_t seed, uint32_t stream,
+                           double randoms[4])
+{
+    const uint32_t counter[4] = {
+        static_cast<uint32_t>(index), stream, 0u, 0u };
+    const uint32_t key[2] = { seed, 0x43554245u };
+    uint32_t bits[4];
+    philox4x32(counter, key, bits);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        randoms[i] = bits[i] * (1.0 / 4294967296.0);
+    }
+}
+
+/**
+ * Writes the translation of the i-th cube at frame 0 into the given 3 values
+ */
+inline void getCubeRestTranslate(int index, const Placement &placement,
+                                 double *translate)
+{
+    switch (placement.mode)
+    {
+    case Placement::kModeBox:
+    {
+        double randoms[4];
+        getCubeRandoms(index, placement.seed, 0, randoms);
+        translate[0] = (randoms[0] - 0.5) * placement.scatterSize;
+        translate[1] = (randoms[1] - 0.5) * placement.scatterSize;
+        translate[2] = (randoms[2] - 0.5) * placement.scatterSize;
+        break;
+    }
+    case Placement::kModeSphere:
+    {
+        double randoms[4];
+        getCubeRandoms(index, placement.seed, 0, randoms);
+        const double z = 2.0 * randoms[0] - 1.0;
+        const double phi = 2.0 * 3.14159265358979323846 * randoms[1];
+        const double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+        const double radius = 0.5 * placement.scatterSize;
+        translate[0] = radius * r * std::cos(phi);
+        translate[1] = radius * r * std::sin(phi);
+        translate[2] = radius * z;
+        break;
+    }
+    case Placement::kModePoints:
+    {
+        const PointSet *points = placement.points;
+        const bool hasPoint =
+            points && index >= 0 && index < points->numberOfPoints;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            translate[axis] = hasPoint ?
+                points->records[static_cast<size_t>(index) * 4 + axis] : 0.0;
+        }
+        break;
+    }
+    default:
+        translate[0] = 0.25 * (index + 2.0) * index;
+        translate[1] = 0.0;
+        translate[2] = 0.0;
+        break;
+    }
+}
+
+/**
+ * Writes the translation of the i-th cube into the given 3 values
+ */
+inline void getCubeTranslate(int index, const Placement &placement,
+                             double *translate)
+{
+    getCubeRestTranslate(index, placement, translate);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        translate[axis] += placement.translationSpeed[axis] * placement.time;
+    }
+}
+
+/**
+ * Returns the uniform scale of the i-th cube
+ */
+inline double getCubeScale(int index, const Placement &placement)
+{
+    if (placement.mode == Placement::kModePoints)
+    {
+        const PointSet *points = placement.points;
+        if (points && index >= 0 && index < points->numberOfPoints)
+        {
+            return placement.scatterScale *
+                points->records[static_cast<size_t>(index) * 4 + 3];
+        }
+        return placement.scatterScale;
+    }
+    if (placement.mode != Placement::kModeLine)
+    {
+        return placement.scatterScale;
+    }
+    return (index + 1.0) * 0.5;
+}
+
+/**
+ * Returns the rotation, in degrees around the X axis, of the i-th cube
+ */
+inline double getCubeRotation(int index, const Placement &placement)
+{
+    return placement.rotationStep * static_cast<double>(index) +
+        placement.rotationSpeed * placement.time;
+}
+
+/**
+ * Writes the translations (3 values per sample) and rotations (1 value per
+ * sample) of the i-th cube at the given times, relative to the placement
+ * time, in a single pass: the position at frame 0, which the scatter modes
+ * draw from the random number generator, is computed once, and the samples
+ * only add the motion to it. The values are the same as the ones of
+ * getCubeTranslate() and getCubeRotation() at each time.
+ */
+inline void getCubeMotion(int index, const Placement &placement,
+                          const float *times, int numberOfSamples,
+                          double *translate, double *rotation)
+{
+    double restTranslate[3];
+    getCubeRestTranslate(index, placement, restTranslate);
+    const double restRotation =
+        placement.rotationStep * static_cast<double>(index);
+
+    for (int sample = 0; sample < numberOfSamples; ++sample)
+    {
+        const double time = placement.time + times[sample];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            translate[sample * 3 + axis] = restTranslate[axis] +
+                placement.translationSpeed[axis] * time;
+        }
+        rotation[sample] = restRotation + placement.rotationSpeed * time;
+    }
+}
+
+/**
+ * Writes the 16 values of the row-major matrix scaling, then rotating, in
+ * degrees around the X axis, and finally translating a cube
+ */
+inline void setCubeMatrix(const double translate[3], double scale,
+                          double rotation, double *matrix)
+{
+    const double radians = rotation * g_degreesToRadians;
+    const double c = std::cos(radians) * scale;
+    const double s = std::sin(radians) * scale;
+
+    const double values[] = { scale, 0.0, 0.0, 0.0,
+                              0.0,   c,   s,   0.0,
+                              0.0,  -s,   c,   0.0,
+                              translate[0], translate[1], translate[2],
+                              1.0 };
+    for (int i = 0; i < 16; ++i)
+    {
+        matrix[i] = values[i];
+    }
+}
+
+/**
+ * Writes the 16 values of the row-major matrix transforming the i-th cube
+ * with the given rotation, in degrees around the X axis: points are scaled,
+ * then rotated and finally translated, as for the separate translate, rotate
+ * and scale components
+ */
+inline void getCubeMatrix(int index, double rotation,
+                          const Placement &placement, double *matrix)
+{
+    double translate[3];
+    getCubeTranslate(index, placement, translate);
+    setCubeMatrix(translate, getCubeScale(index, placement), rotation,
+                  matrix);
+}
+
+/**
+ * Returns the largest extent, along Y and Z, of a unit square rotated
+ * around X by any angle between the two given ones, in degrees: the maximum
+ * of |cos| + |sin| over the interval
+ */
+inline double getMaxRotatedExtent(double fromDegrees, double toDegrees)
+{
+    const double low = std::min(fromDegrees, toDegrees);
+    const double high = std::max(fromDegrees, toDegrees);
+
+    // The maxima are at 45 degrees modulo 90, and the function is monotonic
+    // in between its extrema, every 45 degrees
+    const double nextMaximum = 45.0 + 90.0 * std::ceil((low - 45.0) / 90.0);
+    if (nextMaximum <= high)
+    {
+        return std::sqrt(2.0);
+    }
+
+    const double lowRadians = low * g_degreesToRadians;
+    const double highRadians = high * g_degreesToRadians;
+    return std::max(
+        std::fabs(std::cos(lowRadians)) + std::fabs(std::sin(lowRadians)),
+        std::fabs(std::cos(highRadians)) + std::fabs(std::sin(highRadians)));
+}
+
+/**
+ * Writes the bounding box, as { xmin, xmax, ymin, ymax, zmin, zmax }, of the
+ * unit cubes of indices in [begin, end), which must not be empty, once
+ * transformed.
+ *
+ * This is computed in constant time, from the placement formulas alone: the
+ * box is exact for the line placement without rotation and conservative
+ * otherwise, the scatter placements being bounded by their whole volume,
+ * and the points placement by the bounding box of all its points, moved by
+ * the translation motion at the placement time.
+ */
+inline void getCubesBound(int begin, int end, const Placement &placement,
+                          double bound[6])
+{
+    const int last = end - 1;
+    const double rotatedExtent = getMaxRotatedExtent(
+        getCubeRotation(begin, placement), getCubeRotation(last, placement));
+
+    if (placement.mode == Placement::kModeLine)
+    {
+        // Both the position and the size of the cubes increase with their
+        // index, as does the left side, at 0.25 * (i^2 + i - 1)
+        double firstTranslate[3], lastTranslate[3];
+        getCubeTranslate(begin, placement, firstTranslate);
+        getCubeTranslate(last, placement, lastTranslate);
+        const double firstHalfSize = 0.5 * getCubeScale(begin, placement);
+        const double lastHalfSize = 0.5 * getCubeScale(last, placement);
+
+        bound[0] = firstTranslate[0] - firstHalfSize;
+        bound[1] = lastTranslate[0] + lastHalfSize;
+        bound[2] = firstTranslate[1] - lastHalfSize * rotatedExtent;
+        bound[3] = firstTranslate[1] + lastHalfSize * rotatedExtent;
+        bound[4] = firstTranslate[2] - lastHalfSize * rotatedExtent;
+        bound[5] = firstTranslate[2] + lastHalfSize * rotatedExtent;
+        return;
+    }
+
+    if (placement.mode == Placement::kModePoints)
+    {
+        // Cubes past the last point lie at the origin, with the plain scale
+        const PointSet *points = placement.points;
+        const bool hasPoints = points && points->numberOfPoints > 0;
+        const bool hasMissingPoints =
+            !points || last >= points->numberOfPoints;
+        double maxScale = hasPoints ? points->maxScale : 0.0;
+        if (hasMissingPoints)
+        {
+            maxScale = std::max(maxScale, 1.0);
+        }
+        const double halfSize =
+            0.5 * std::fabs(placement.scatterScale) * maxScale;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double extent = axis == 0 ? 1.0 : rotatedExtent;
+            double low = hasPoints ? points->bound[axis * 2] : 0.0;
+            double high = hasPoints ? points->bound[axis * 2 + 1] : 0.0;
+            if (hasMissingPoints)
+            {
+                low = std::min(low, 0.0);
+                high = std::max(high, 0.0);
+            }
+            bound[axis * 2] = low - halfSize * extent;
+            bound[axis * 2 + 1] = high + halfSize * extent;
+        }
+    }
+    else
+    {
+        // The box and sphere placements both lie within a cube of edge
+        // 'scatterSize'
+        const double halfSize = 0.5 * std::fabs(placement.scatterScale);
+        const double halfExtent = 0.5 * std::fabs(placement.scatterSize);
+        bound[0] = -halfExtent - halfSize;
+        bound[1] = halfExtent + halfSize;
+        bound[2] = bound[4] = -halfExtent - halfSize * rotatedExtent;
+        bound[3] = bound[5] = halfExtent + halfSize * rotatedExtent;
+    }
+
+    // All the cubes move along with the translation motion
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const double offset = placement.translationSpeed[axis] * placement.time;
+        bound[axis * 2] += offset;
+        bound[axis * 2 + 1] += offset;
+    }
+}
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERPLACEMENT_H
@@ -0,0 +1,206 @@
+#ifndef KATANAOPS_CUBEMAKERPOINTS_H
+#define KATANAOPS_CUBEMAKERPOINTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "CubeMakerPlacement.h"
+#include "MappedFile.h"
+
+namespace CubeMaker
+{
+
+/**
+ * Header of the point files read by the 'points' placement.
+ *
+ * A point file holds this header followed by one record of 4 floats per
+ * point: its position (x, y and z) and the scale of the cube placed at it.
+ * The bounding box is the one of the positions, as { xmin, xmax, ymin,
+ * ymax, zmin, zmax }, and the maximum scale the largest absolute scale, so
+ * that the bounds of the cubes don't need to read the records. All values
+ * are stored in the native byte order (little-endian on the supported
+ * platforms).
+ */
+struct PointFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t numberOfPoints;
+    double bound[6];
+    double maxScale;
+};
+
+static_assert(sizeof(PointFileHeader) == 72,
+              "The point file header must not be padded");
+
+const char g_pointFileMagic[4] = { 'K', 'O', 'P', 'C' };
+const uint32_t g_pointFileVersion = 1;
+
+/**
+ * PointFile
+ *
+ * A point file, memory mapped, and the points it holds, which reference the
+ * mapping
+ */
+struct PointFile
+{
+    KatanaOps::MappedFile file;
+    PointSet points;
+};
+
+typedef std::shared_ptr<const PointFile> PointFilePtr;
+
+/**
+ * Returns the point file of the given path, or null, setting 'error', if it
+ * can't be read.
+ *
+ * Files are memory mapped on first use, the records being read from disk
+ * only when the cubes placed at them are cooked, and stay mapped as long as
+ * the returned pointer, or the pointer returned by any call made since, is
+ * held: hold it while using its points. Each call checks the identity of
+ * the file on disk (see KatanaOps::FileIdentity), mapping it again once it
+ * has been replaced, the mapping of the previous file being released by
+ * the last cook holding it. Files must be replaced rather than rewritten in
+ * place, as writePointFile() does, or the cooks still reading the previous
+ * file fail. Can be called from concurrent cooks.
+ */
+inline PointFilePtr getPointFile(const std::string &path, std::string &error)
+{
+    typedef std::map<std::string, PointFilePtr> PointFileMap;
+    static std::mutex s_mutex;
+    // Never destroyed, the files being referenced by the cooks of other
+    // threads, up to the unloading of the plug-in
+    static PointFileMap &s_pointFiles = *new PointFileMap;
+
+    KatanaOps::FileIdentity identity;
+    const bool found = KatanaOps::getFileIdentity(path, identity, error);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    PointFileMap::iterator it = s_pointFiles.find(path);
+    if (!found)
+    {
+        if (it != s_pointFiles.end())
+        {
+            s_pointFiles.erase(it);
+        }
+        return PointFilePtr();
+    }
+    if (it != s_pointFiles.end() && it->second->file.identity() == identity)
+    {
+        return it->second;
+    }
+
+    // Mapping doesn't read the file, so this doesn't hold the lock for
+    // long. Failures aren't kept, so that a file can be fixed on disk
+    std::shared_ptr<PointFile> pointFile(new PointFile);
+    if (!pointFile->file.open(path, error))
+    {
+        return PointFilePtr();
+    }
+
+    const size_t size = pointFile->file.size();
+    const char *data = static_cast<const char*>(pointFile->file.data());
+    PointFileHeader header;
+    if (size < sizeof(header))
+    {
+        error = "file too small for a point file header";
+        return PointFilePtr();
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, g_pointFileMagic, 4) != 0)
+    {
+        error = "not a point file";
+        return PointFilePtr();
+    }
+    if (header.version != g_pointFileVersion)
+    {
+        error = "unsupported point file version";
+        return PointFilePtr();
+    }
+    if (header.numberOfPoints >
+        (size - sizeof(header)) / (4 * sizeof(float)))
+    {
+        error = "truncated point file";
+        return PointFilePtr();
+    }
+
+    PointSet &points = pointFile->points;
+    points.records = reinterpret_cast<const float*>(data + sizeof(header));
+    points.numberOfPoints = static_cast<int64_t>(header.numberOfPoints);
+    std::copy(header.bound, header.bound + 6, points.bound);
+    points.maxScale = header.maxScale;
+
+    // Replaces the previous file, if any, released with its last user
+    s_pointFiles[path] = pointFile;
+    return pointFile;
+}
+
+/**
+ * Writes a point file holding the given records, of 4 floats each, to the
+ * given path, returns false, and sets 'error', if it can't be written. The
+ * file is written next to the path first, then renamed, so that the cooks
+ * still reading the file it replaces aren't affected.
+ */
+inline bool writePointFile(const std::string &path, const float *records,
+                           uint64_t numberOfPoints, std::string &error)
+{
+    PointFileHeader header;
+    std::memcpy(header.magic, g_pointFileMagic, 4);
+    header.version = g_pointFileVersion;
+    header.numberOfPoints = numberOfPoints;
+    header.maxScale = 0.0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        header.bound[axis * 2] = numberOfPoints > 0 ? records[axis] : 0.0;
+        header.bound[axis * 2 + 1] = header.bound[axis * 2];
+    }
+    for (uint64_t i = 0; i < numberOfPoints; ++i)
+    {
+        const float *record = records + i * 4;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            header.bound[axis * 2] =
+                std::min<double>(header.bound[axis * 2], record[axis]);
+            header.bound[axis * 2 + 1] =
+                std::max<double>(header.bound[axis * 2 + 1], record[axis]);
+        }
+        header.maxScale =
+            std::max<double>(header.maxScale, std::fabs(record[3]));
+    }
+
+    std::string temporaryPath;
+    std::FILE *file = KatanaOps::createTemporaryFile(path, temporaryPath);
+    if (!file)
+    {
+        error = "cannot open file for writing";
+        return false;
+    }
+    const bool written =
+        std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(records, 4 * sizeof(float),
+                    static_cast<size_t>(numberOfPoints), file) ==
+            static_cast<size_t>(numberOfPoints);
+    if (std::fclose(file) != 0 || !written)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "cannot write file";
+        return false;
+    }
+    if (!KatanaOps::replaceFile(temporaryPath, path))
+    {
+        std::remove(temporaryPath.c_str());
+        error = "cannot replace file";
+        return false;
+    }
+    return true;
+}
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERPOINTS_H
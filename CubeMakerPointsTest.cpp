@@ -0,0 +1,215 @@
+// Checks the reading and writing of the point files of the CubeMaker Op.
+//
+// Writes point files, in the working directory, with writePointFile(), and
+// checks that getPointFile() maps them back with the same points, that it
+// rejects truncated files and files of another magic or version, and that
+// a file replaced while its points are held keeps them readable, the next
+// call mapping the new file. Run by ctest; exits with a non-zero status if
+// any check fails.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CubeMakerPoints.h"
+
+namespace { //anonymous
+
+using CubeMaker::PointFileHeader;
+using CubeMaker::PointFilePtr;
+
+int g_failures = 0;
+
+void check(bool condition, const char *message)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", message);
+        ++g_failures;
+    }
+}
+
+/**
+ * Returns the records of the given number of points, of 4 floats each,
+ * varying with the given seed
+ */
+std::vector<float> makeRecords(int numberOfPoints, float seed)
+{
+    std::vector<float> records(static_cast<size_t>(numberOfPoints) * 4);
+    for (int i = 0; i < numberOfPoints; ++i)
+    {
+        records[i * 4] = seed + i;
+        records[i * 4 + 1] = -seed * i;
+        records[i * 4 + 2] = 0.5f * i;
+        records[i * 4 + 3] = 1.0f + 0.25f * (i % 4);
+    }
+    return records;
+}
+
+/**
+ * Returns whether the given point file holds the given records, and bounds
+ * them
+ */
+bool holdsRecords(const PointFilePtr &pointFile,
+                  const std::vector<float> &records)
+{
+    if (!pointFile)
+    {
+        return false;
+    }
+    const CubeMaker::PointSet &points = pointFile->points;
+    if (points.numberOfPoints * 4 != static_cast<int64_t>(records.size()) ||
+        std::memcmp(points.records, records.data(),
+                    records.size() * sizeof(float)) != 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < records.size(); i += 4)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (records[i + axis] < points.bound[axis * 2] ||
+                records[i + axis] > points.bound[axis * 2 + 1])
+            {
+                return false;
+            }
+        }
+        if (records[i + 3] > points.maxScale)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readFile(const std::string &path, std::vector<char> &content)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    content.clear();
+    char buffer[65536];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.insert(content.end(), buffer, buffer + count);
+    }
+    std::fclose(file);
+    return true;
+}
+
+/**
+ * Writes the given content to the given path, replacing the file, if any,
+ * so that mappings of the previous file aren't affected
+ */
+bool writeFile(const std::string &path, const char *data, size_t size)
+{
+    std::string temporaryPath;
+    std::FILE *file = KatanaOps::createTemporaryFile(path, temporaryPath);
+    if (!file)
+    {
+        return false;
+    }
+    const bool written = std::fwrite(data, 1, size, file) == size;
+    if (std::fclose(file) != 0 || !written ||
+        !KatanaOps::replaceFile(temporaryPath, path))
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Returns whether getPointFile() rejects the given file content, setting
+ * an error
+ */
+bool isRejected(const std::string &path, const std::vector<char> &content)
+{
+    if (!writeFile(path, content.data(), content.size()))
+    {
+        return false;
+    }
+    std::string error;
+    const PointFilePtr pointFile = CubeMaker::getPointFile(path, error);
+    return !pointFile && !error.empty();
+}
+
+} // anonymous
+
+int main()
+{
+    const std::string path = "CubeMakerPointsTest.kpc";
+    std::string error;
+
+    // Round trip
+    const std::vector<float> records = makeRecords(1000, 1.0f);
+    check(CubeMaker::writePointFile(path, records.data(), 1000, error),
+          "writePointFile() writes the file");
+    PointFilePtr pointFile = CubeMaker::getPointFile(path, error);
+    check(holdsRecords(pointFile, records),
+          "getPointFile() maps the points written");
+    check(CubeMaker::getPointFile(path, error) == pointFile,
+          "getPointFile() shares the mapping of an unchanged file");
+
+    // Corrupted files
+    std::vector<char> content;
+    check(readFile(path, content) &&
+          content.size() ==
+              sizeof(PointFileHeader) + records.size() * sizeof(float),
+          "point file has a header and 4 floats per point");
+    if (content.size() > sizeof(PointFileHeader))
+    {
+        const std::vector<char> truncated(
+            content.begin(), content.end() - sizeof(float));
+        check(isRejected(path, truncated), "truncated file is rejected");
+
+        const std::vector<char> headerOnly(
+            content.begin(), content.begin() + sizeof(PointFileHeader) / 2);
+        check(isRejected(path, headerOnly),
+              "file truncated within its header is rejected");
+
+        std::vector<char> badMagic(content);
+        badMagic[offsetof(PointFileHeader, magic)] = 'X';
+        check(isRejected(path, badMagic), "file of another magic is rejected");
+
+        std::vector<char> badVersion(content);
+        const uint32_t version = CubeMaker::g_pointFileVersion + 1;
+        std::memcpy(&badVersion[offsetof(PointFileHeader, version)],
+                    &version, sizeof(version));
+        check(isRejected(path, badVersion),
+              "file of another version is rejected");
+    }
+
+    // Replacing the file while its points are held
+    check(CubeMaker::writePointFile(path, records.data(), 1000, error),
+          "writePointFile() rewrites the file");
+    pointFile = CubeMaker::getPointFile(path, error);
+    const std::vector<float> newRecords = makeRecords(500, 2.0f);
+    check(CubeMaker::writePointFile(path, newRecords.data(), 500, error),
+          "writePointFile() replaces the file");
+    check(holdsRecords(pointFile, records),
+          "points held stay readable once the file is replaced");
+    const PointFilePtr newPointFile = CubeMaker::getPointFile(path, error);
+    check(newPointFile != pointFile && holdsRecords(newPointFile, newRecords),
+          "getPointFile() maps the file replaced");
+    pointFile.reset();
+    check(holdsRecords(newPointFile, newRecords),
+          "releasing the previous file keeps the new one");
+
+    std::remove(path.c_str());
+    check(!CubeMaker::getPointFile(path, error), "missing file is rejected");
+
+    if (g_failures > 0)
+    {
+        std::fprintf(stderr, "%d checks failed.\n", g_failures);
+        return 1;
+    }
+    std::printf("Point file checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef KATANAOPS_CUBEMAKERPRIMVARS_H
+#define KATANAOPS_CUBEMAKERPRIMVARS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "CubeMakerPlacement.h"
+
+namespace CubeMaker
+{
+
+/**
+ * Primvars
+ *
+ * Selects the arbitrary attributes, or primvars, given to the cubes:
+ * 'displayColor', a random color, and 'instanceId', the index of the cube
+ * in its set. Both only depend on the index of the cube (and the seed of the
+ * placement for the colors), so that leaf locations derive their own values
+ * at cook time, and instance arrays fill one array per primvar for all the
+ * cubes. Like CubeMakerPlacement.h, this header only depends on the
+ * standard library.
+ */
+struct Primvars
+{
+    Primvars() : displayColor(false), instanceId(false) {}
+
+    /**
+     * Returns whether any primvar is given to the cubes
+     */
+    bool any() const { return displayColor || instanceId; }
+
+    bool displayColor;
+    bool instanceId;
+};
+
+/**
+ * Writes the display color of the i-th cube, uniformly distributed in the
+ * RGB unit cube, into the given 3 values
+ */
+inline void getCubeColor(int index, const Placement &placement, float *color)
+{
+    // Stream 1, so that the colors don't correlate with the positions
+    double randoms[4];
+    getCubeRandoms(index, placement.seed, 1, randoms);
+    color[0] = static_cast<float>(randoms[0]);
+    color[1] = static_cast<float>(randoms[1]);
+    color[2] = static_cast<float>(randoms[2]);
+}
+
+/**
+ * Writes the display colors of the cubes of indices in [begin, end) into
+ * the given array, of 3 values per cube
+ */
+inline void fillCubeColors(size_t begin, size_t end,
+                           const Placement &placement, float *colors)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        getCubeColor(static_cast<int>(i), placement, colors + (i - begin) * 3);
+    }
+}
+
+/**
+ * Writes the instance ids of the cubes of indices in [begin, end) into the
+ * given array
+ */
+inline void fillCubeIds(size_t begin, size_t end, int *ids)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        ids[i - begin] = static_cast<int>(i);
+    }
+}
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERPRIMVARS_H
@@ -0,0 +1,346 @@
+#ifndef KATANAOPS_CUBEMAKERPROCEDURAL_H
+#define KATANAOPS_CUBEMAKERPROCEDURAL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CubeMakerGrid.h"
+#include "CubeMakerMesh.h"
+#include "CubeMakerPlacement.h"
+#include "CubeMakerPoints.h"
+#include "CubeMakerPrimvars.h"
+
+namespace CubeMaker
+{
+
+/**
+ * ProceduralArgs
+ *
+ * Arguments of a set of cubes expanded by a renderer procedural, as given
+ * by the 'rendererProcedural.args' attribute of the 'procedural' output
+ * mode: the number of cubes and the values of the 'params' group, see
+ * CubeMakerOp::buildParams(). Set them by name, from whatever the renderer
+ * hands its procedurals, with setProceduralArg().
+ */
+struct ProceduralArgs
+{
+    ProceduralArgs() : numberOfCubes(0) {}
+
+    int numberOfCubes;
+    Placement placement;
+    MotionSamples motion;
+    MeshDetail detail;
+    Primvars primvars;
+    std::string pointFile;
+};
+
+/**
+ * Sets the numeric argument of the given name to the given values, returns
+ * false if the name or the number of values doesn't match any argument.
+ * Integer and boolean arguments are given as doubles as well.
+ */
+inline bool setProceduralArg(ProceduralArgs &args, const std::string &name,
+                             const double *values, size_t numberOfValues)
+{
+    if (numberOfValues == 3)
+    {
+        double *target = nullptr;
+        if (name == "lodCenter")
+        {
+            target = args.detail.lodCenter;
+        }
+        else if (name == "translationSpeed")
+        {
+            target = args.placement.translationSpeed;
+        }
+        if (target)
+        {
+            std::copy(values, values + 3, target);
+            return true;
+        }
+        return false;
+    }
+    if (numberOfValues != 1)
+    {
+        return false;
+    }
+
+    const double value = values[0];
+    const int intValue = static_cast<int>(value);
+    if (name == "numberOfCubes")
+    {
+        args.numberOfCubes = std::max(intValue, 0);
+    }
+    else if (name == "rotationStep")
+    {
+        args.placement.rotationStep = value;
+    }
+    else if (name == "seed")
+    {
+        args.placement.seed = static_cast<uint32_t>(intValue);
+    }
+    else if (name == "scatterSize")
+    {
+        args.placement.scatterSize = value;
+    }
+    else if (name == "scatterScale")
+    {
+        args.placement.scatterScale = value;
+    }
+    else if (name == "frame")
+    {
+        args.placement.time = value;
+    }
+    else if (name == "rotationSpeed")
+    {
+        args.placement.rotationSpeed = value;
+    }
+    else if (name == "motionSamples")
+    {
+        args.motion.numberOfSamples = std::min(
+            std::max(intValue, 1),
+            static_cast<int>(MotionSamples::kMaxSamples));
+    }
+    else if (name == "shutterOpen")
+    {
+        args.motion.shutterOpen = value;
+    }
+    else if (name == "shutterClose")
+    {
+        args.motion.shutterClose = value;
+    }
+    else if (name == "subdivisions")
+    {
+        args.detail.subdivisions = std::min(
+            std::max(intValue, 0),
+            static_cast<int>(MeshDetail::kMaxSubdivisions));
+    }
+    else if (name == "roundness")
+    {
+        args.detail.roundness = std::min(std::max(value, 0.0), 1.0);
+    }
+    else if (name == "lodDistance")
+    {
+        args.detail.lodDistance = value;
+    }
+    else if (name == "displayColor")
+    {
+        args.primvars.displayColor = intValue != 0;
+    }
+    else if (name == "instanceId")
+    {
+        args.primvars.instanceId = intValue != 0;
+    }
+    else if (name == "xformMatrix")
+    {
+        // Procedurals always get matrices, see CubeExpander
+    }
+    else if (name == "pointFileStamp")
+    {
+        // Point files are identified on disk, see getPointFile()
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Sets the string argument of the given name to the given value, returns
+ * false if the name or the value doesn't match any argument
+ */
+inline bool setProceduralArg(ProceduralArgs &args, const std::string &name,
+                             const std::string &value)
+{
+    if (name == "placement")
+    {
+        return getPlacementMode(value, args.placement.mode);
+    }
+    if (name == "pointFile")
+    {
+        args.pointFile = value;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * CubeExpander
+ *
+ * Expands a set of cubes inside a renderer, from the arguments of its
+ * procedural, without Katana: the shapes, transforms, bounds and primvars
+ * are the ones the 'locations' output mode gives the leaf locations, as
+ * they come from the same functions.
+ *
+ * Cubes are meant to be expanded lazily, a region of the frame at a time:
+ * getCubesInRegion() sorts them, on first use, into the same uniform grid as
+ * the spatial bucket groups, so that each query only visits the cubes it
+ * may return. All the other functions only depend on the cube index, and
+ * all of them can be called from concurrent threads once open() returned.
+ */
+class CubeExpander
+{
+public:
+
+    explicit CubeExpander(const ProceduralArgs &args)
+        : m_args(args)
+    {
+        m_args.placement.numberOfCubes = args.numberOfCubes;
+    }
+
+    /**
+     * Reads the point file of the points placement, if any, returns false,
+     * and sets 'error', if it can't be read. The number of cubes is clamped
+     * to the number of points, and the file stays mapped as long as the
+     * expander.
+     */
+    bool open(std::string &error)
+    {
+        if (m_args.placement.mode != Placement::kModePoints)
+        {
+            return true;
+        }
+        m_pointFile = getPointFile(m_args.pointFile, error);
+        if (!m_pointFile)
+        {
+            return false;
+        }
+        m_args.placement.points = &m_pointFile->points;
+        m_args.placement.numberOfCubes = static_cast<int>(std::min<int64_t>(
+            m_args.placement.numberOfCubes,
+            m_pointFile->points.numberOfPoints));
+        return true;
+    }
+
+    int getNumberOfCubes() const { return m_args.placement.numberOfCubes; }
+    int getNumberOfSamples() const { return m_args.motion.numberOfSamples; }
+
+    /**
+     * Returns the time of the given motion sample, relative to the frame
+     */
+    float getSampleTime(int sample) const
+    {
+        return m_args.motion.getSampleTime(sample);
+    }
+
+    /**
+     * Writes the bounding box of all the cubes, over all the motion samples,
+     * as { xmin, xmax, ymin, ymax, zmin, zmax }, returns false if there are
+     * no cubes
+     */
+    bool getBound(double bound[6]) const
+    {
+        const int numberOfCubes = getNumberOfCubes();
+        if (numberOfCubes <= 0)
+        {
+            return false;
+        }
+        for (int sample = 0; sample < getNumberOfSamples(); ++sample)
+        {
+            Placement samplePlacement = m_args.placement;
+            samplePlacement.time += getSampleTime(sample);
+            double sampleBound[6];
+            getCubesBound(0, numberOfCubes, samplePlacement, sampleBound);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                bound[axis * 2] = sample == 0 ? sampleBound[axis * 2] :
+                    std::min(bound[axis * 2], sampleBound[axis * 2]);
+                bound[axis * 2 + 1] = sample == 0 ?
+                    sampleBound[axis * 2 + 1] :
+                    std::max(bound[axis * 2 + 1], sampleBound[axis * 2 + 1]);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Appends the indices of the cubes that may intersect the given region,
+     * as { xmin, xmax, ymin, ymax, zmin, zmax }, at the frame, to the given
+     * vector
+     */
+    void getCubesInRegion(const double region[6],
+                          std::vector<int> &cubes) const
+    {
+        if (getNumberOfCubes() <= 0)
+        {
+            return;
+        }
+        std::call_once(m_gridFlag, [this]()
+        {
+            m_grid.reset(new CubeGrid(m_args.placement));
+        });
+        m_grid->getCubesInRegion(0, 0, m_args.placement, region, cubes);
+    }
+
+    /**
+     * Writes the row-major matrices of the i-th cube, 16 values for each
+     * motion sample, see getCubeMatrix()
+     */
+    void getCubeMatrices(int index, double *matrices) const
+    {
+        for (int sample = 0; sample < getNumberOfSamples(); ++sample)
+        {
+            Placement samplePlacement = m_args.placement;
+            samplePlacement.time += getSampleTime(sample);
+            getCubeMatrix(index, getCubeRotation(index, samplePlacement),
+                          samplePlacement, matrices + sample * 16);
+        }
+    }
+
+    /**
+     * Returns the mesh level of the i-th cube, see getMesh()
+     */
+    int getCubeLevel(int index) const
+    {
+        return CubeMaker::getCubeLevel(index, m_args.placement,
+                                       m_args.detail);
+    }
+
+    /**
+     * Fills the given vectors with the cube mesh of the given level, with
+     * the roundness of the set, see buildMesh()
+     */
+    void getMesh(int level, std::vector<float> &points,
+                 std::vector<int> &vertexList,
+                 std::vector<int> &startIndex) const
+    {
+        int64_t numPoints = 0;
+        int64_t numFaces = 0;
+        getMeshSizes(level, numPoints, numFaces);
+        points.resize(static_cast<size_t>(numPoints) * 3);
+        vertexList.resize(static_cast<size_t>(numFaces) * 4);
+        startIndex.resize(static_cast<size_t>(numFaces) + 1);
+        buildMesh(level, m_args.detail.roundness, points.data(),
+                  vertexList.data(), startIndex.data());
+    }
+
+    /**
+     * Returns the primvars to give the cubes, see getCubeColor()
+     */
+    const Primvars& getPrimvars() const { return m_args.primvars; }
+
+    /**
+     * Writes the display color of the i-th cube into the given 3 values
+     */
+    void getCubeColor(int index, float *color) const
+    {
+        CubeMaker::getCubeColor(index, m_args.placement, color);
+    }
+
+private:
+
+    ProceduralArgs m_args;
+    PointFilePtr m_pointFile;
+    mutable std::once_flag m_gridFlag;
+    mutable std::unique_ptr<const CubeGrid> m_grid;
+};
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERPROCEDURAL_H
@@ -0,0 +1,177 @@
+// Checks that the CubeMaker leaves share their constant attributes.
+//
+// Cooks cube leaves of a few subdivision levels, through MockCookInterface,
+// on concurrent threads, and checks that their geometry, bound, type and
+// rotations are the very attributes the Op keeps to hand out, not equal
+// copies of them, so that Geolib and the renderers see a single handle. Run
+// by ctest; exits with a non-zero status, after reporting the first
+// mismatch, if any leaf attribute isn't shared.
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+#include <FnAttribute/FnGroupBuilder.h>
+
+#include "CubeMakerOp.h"
+#include "MockCookInterface.h"
+
+namespace { //anonymous
+
+using KatanaOps::MockCookInterface;
+
+/**
+ * Exposes the shared attributes of the Op to the test
+ */
+struct CubeMakerOpAccess : public CubeMaker::CubeMakerOp
+{
+    using CubeMakerOp::getCachedMesh;
+    using CubeMakerOp::getCachedMeshBound;
+    using CubeMakerOp::getCachedMeshType;
+    using CubeMakerOp::getCachedRotateY;
+    using CubeMakerOp::getCachedRotateZ;
+};
+
+const int kNumThreads = 4;
+const int kLeavesPerThread = 256;
+
+/**
+ * Collects the first failure reported by the cook threads
+ */
+class Failures
+{
+public:
+
+    Failures() : m_count(0) {}
+
+    void add(const std::string &message)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_count++ == 0)
+        {
+            m_first = message;
+        }
+    }
+
+    int getCount() const { return m_count; }
+    const std::string& getFirst() const { return m_first; }
+
+private:
+
+    std::mutex m_mutex;
+    int m_count;
+    std::string m_first;
+};
+
+/**
+ * Cooks the leaves of the given indices, of the given subdivision level,
+ * checking each of their constant attributes
+ */
+void cookLeaves(int level, int firstIndex, int count, Failures &failures)
+{
+    FnAttribute::GroupBuilder paramsBuilder;
+    paramsBuilder.set("rotationStep", FnAttribute::DoubleAttribute(0.09));
+    paramsBuilder.set("subdivisions", FnAttribute::IntAttribute(level));
+    const FnAttribute::GroupAttribute paramsAttr = paramsBuilder.build();
+
+    const KatanaOps::SharedGroupAttribute geometry =
+        CubeMakerOpAccess::getCachedMesh(level, 0.0);
+    const KatanaOps::SharedDoubleAttribute &bound =
+        CubeMakerOpAccess::getCachedMeshBound();
+    const KatanaOps::SharedStringAttribute &type =
+        CubeMakerOpAccess::getCachedMeshType();
+    const KatanaOps::SharedDoubleAttribute &rotateY =
+        CubeMakerOpAccess::getCachedRotateY();
+    const KatanaOps::SharedDoubleAttribute &rotateZ =
+        CubeMakerOpAccess::getCachedRotateZ();
+
+    for (int index = firstIndex; index < firstIndex + count; ++index)
+    {
+        const FnAttribute::GroupAttribute opArgs(
+            "leaf", FnAttribute::IntAttribute(index),
+            "params", paramsAttr,
+            true);
+        MockCookInterface interface(opArgs, "/root/world/geo/cubeMaker/cube");
+        interface.recordAttrs();
+        CubeMaker::CubeMakerOp::cookLocation(interface);
+
+        const FnAttribute::GroupAttribute xformAttr =
+            interface.getAttr("xform");
+        const char *attrName = nullptr;
+        if (!geometry.isSameAttr(interface.getAttr("geometry")))
+        {
+            attrName = "geometry";
+        }
+        else if (!bound.isSameAttr(interface.getAttr("bound")))
+        {
+            attrName = "bound";
+        }
+        else if (!type.isSameAttr(interface.getAttr("type")))
+        {
+            attrName = "type";
+        }
+        else if (!rotateY.isSameAttr(xformAttr.getChildByName("rotateY")))
+        {
+            attrName = "xform.rotateY";
+        }
+        else if (!rotateZ.isSameAttr(xformAttr.getChildByName("rotateZ")))
+        {
+            attrName = "xform.rotateZ";
+        }
+
+        if (attrName)
+        {
+            char message[128];
+            std::snprintf(message, sizeof(message),
+                          "leaf %d of subdivision level %d: %s not shared",
+                          index, level, attrName);
+            failures.add(message);
+            return;
+        }
+    }
+}
+
+} // anonymous
+
+int main()
+{
+    // The FnAttribute library needs to be bootstrapped when used outside
+    // of a Katana process
+    const char *katanaRoot = std::getenv("KATANA_ROOT");
+    if (!FnAttribute::Bootstrap(katanaRoot ? katanaRoot
+                                           : CUBEMAKER_TEST_KATANA_ROOT))
+    {
+        std::fprintf(stderr, "Cannot bootstrap the FnAttribute library.\n");
+        return 1;
+    }
+
+    Failures failures;
+    const int levels[] = { 0, 2 };
+    for (int level : levels)
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kNumThreads; ++i)
+        {
+            threads.emplace_back(cookLeaves, level, i * kLeavesPerThread,
+                                 kLeavesPerThread, std::ref(failures));
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    if (failures.getCount() > 0)
+    {
+        std::fprintf(stderr, "%d cook threads failed, first: %s\n",
+                     failures.getCount(), failures.getFirst().c_str());
+        return 1;
+    }
+    std::printf("Leaf attributes shared by %d threads.\n", kNumThreads);
+    return 0;
+}
@@ -0,0 +1,322 @@
+#ifndef KATANAOPS_CUBEMAKERTOPOLOGY_H
+#define KATANAOPS_CUBEMAKERTOPOLOGY_H
+
+namespace CubeMaker
+{
+
+/**
+ * Closed-form topology of the subdivided cube meshes.
+ *
+ * The points of a level L mesh are the surface points of the regular
+ * lattice of 2^L + 1 points along each edge of the cube, numbered in
+ * lattice order (x varying fastest, then y, then z), and its faces are the
+ * 2^L x 2^L quads of each side of the cube. Every value is given by a
+ * constexpr function of its index, so that the tables of the common levels
+ * can be generated at compile time, see MeshTables, and the others at
+ * runtime from the same formulas, see buildMesh().
+ */
+namespace topology
+{
+
+/**
+ * Highest level whose tables are generated at compile time
+ */
+const int g_maxCompiledLevel = 4;
+
+/**
+ * For each side of the cube: the axis of its normal, whether it lies on the
+ * positive side, and the two axes across it, ordered so that the faces are
+ * wound as the ones of the level 0 cube tables
+ */
+constexpr int g_sides[6][4] = {
+    { 2, 1, 0, 1 }, { 1, 1, 2, 0 }, { 2, 0, 1, 0 },
+    { 1, 0, 0, 2 }, { 0, 1, 1, 2 }, { 0, 0, 2, 1 } };
+
+/**
+ * Lattice offsets, across the side of the cube, of the corners of a quad
+ */
+constexpr int g_corners[4][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } };
+
+constexpr int getSegments(int level)
+{
+    return 1 << level;
+}
+
+/**
+ * Returns the number of points of a full slice of the lattice (z = 0 or
+ * z = segments)
+ */
+constexpr int getSliceSize(int segments)
+{
+    return (segments + 1) * (segments + 1);
+}
+
+/**
+ * Returns the number of points of an inner slice of the lattice, only its
+ * border being on the surface
+ */
+constexpr int getRingSize(int segments)
+{
+    return getSliceSize(segments) - (segments - 1) * (segments - 1);
+}
+
+constexpr int getNumPoints(int level)
+{
+    return 2 * getSliceSize(getSegments(level)) +
+        (getSegments(level) - 1) * getRingSize(getSegments(level));
+}
+
+constexpr int getNumFaces(int level)
+{
+    return 6 * getSegments(level) * getSegments(level);
+}
+
+constexpr int getNumVertices(int level)
+{
+    return 4 * getNumFaces(level);
+}
+
+/**
+ * Returns the index of the point at the given surface lattice coordinates
+ */
+constexpr int getPointIndex(int segments, int x, int y, int z)
+{
+    return z == 0 ? y * (segments + 1) + x :
+        z == segments ?
+            getSliceSize(segments) + (segments - 1) * getRingSize(segments) +
+            y * (segments + 1) + x :
+        getSliceSize(segments) + (z - 1) * getRingSize(segments) +
+            (y == 0 ? x :
+             y == segments ? getRingSize(segments) - (segments + 1) + x :
+             (segments + 1) + (y - 1) * 2 + (x == 0 ? 0 : 1));
+}
+
+/**
+ * Returns the given lattice coordinate of the point within a slice, the
+ * point being given by its index within the slice
+ */
+constexpr int getSliceCoordinate(int segments, int index, int axis)
+{
+    return axis == 0 ? index % (segments + 1) : index / (segments + 1);
+}
+
+/**
+ * Returns the given lattice coordinate of the point within an inner slice,
+ * the point being given by its index within the ring
+ */
+constexpr int getRingCoordinate(int segments, int index, int axis)
+{
+    return index < segments + 1 ?
+            (axis == 0 ? index : 0) :
+        index >= getRingSize(segments) - (segments + 1) ?
+            (axis == 0 ?
+                index - (getRingSize(segments) - (segments + 1)) :
+                segments) :
+        (axis == 0 ?
+            ((index - (segments + 1)) % 2 == 0 ? 0 : segments) :
+            1 + (index - (segments + 1)) / 2);
+}
+
+/**
+ * Returns the given lattice coordinate of the point of the given index,
+ * the inverse of getPointIndex()
+ */
+constexpr int getLatticeCoordinate(int segments, int point, int axis)
+{
+    return point < getSliceSize(segments) ?
+            (axis == 2 ? 0 : getSliceCoordinate(segments, point, axis)) :
+        point >= getSliceSize(segments) +
+                 (segments - 1) * getRingSize(segments) ?
+            (axis == 2 ? segments : getSliceCoordinate(
+                segments,
+                point - getSliceSize(segments) -
+                    (segments - 1) * getRingSize(segments),
+                axis)) :
+        (axis == 2 ?
+            1 + (point - getSliceSize(segments)) / getRingSize(segments) :
+            getRingCoordinate(
+                segments,
+                (point - getSliceSize(segments)) % getRingSize(segments),
+                axis));
+}
+
+/**
+ * Returns the given coordinate of the point of the given index, on the unit
+ * cube centred on the origin
+ */
+constexpr float getPointCoordinate(int level, int point, int axis)
+{
+    return static_cast<float>(
+        -0.5 + static_cast<double>(getLatticeCoordinate(
+            getSegments(level), point, axis)) / getSegments(level));
+}
+
+/**
+ * Returns the given lattice coordinate of the corner of a quad, given by the
+ * side of the cube, the quad position across the side and the corner
+ */
+constexpr int getCornerCoordinate(int segments, int side, int u, int v,
+                                  int corner, int axis)
+{
+    return axis == g_sides[side][0] ? (g_sides[side][1] ? segments : 0) :
+        axis == g_sides[side][2] ? u + g_corners[corner][0] :
+        v + g_corners[corner][1];
+}
+
+constexpr int getQuadVertex(int segments, int side, int u, int v, int corner)
+{
+    return getPointIndex(
+        segments,
+        getCornerCoordinate(segments, side, u, v, corner, 0),
+        getCornerCoordinate(segments, side, u, v, corner, 1),
+        getCornerCoordinate(segments, side, u, v, corner, 2));
+}
+
+/**
+ * Returns the index of the point of the given vertex, for all the quads of
+ * each side of the cube in turn, row by row
+ */
+constexpr int getVertex(int level, int vertex)
+{
+    return getQuadVertex(
+        getSegments(level),
+        vertex / (4 * getSegments(level) * getSegments(level)),
+        (vertex / 4) % getSegments(level),
+        (vertex / 4 / getSegments(level)) % getSegments(level),
+        vertex % 4);
+}
+
+constexpr int getStartIndex(int face)
+{
+    return 4 * face;
+}
+
+//------------------------------------------------------------------------------
+// Compile-time tables
+
+template <int... Indices>
+struct IndexSequence
+{
+};
+
+template <typename First, typename Second>
+struct ConcatIndexSequences;
+
+template <int... First, int... Second>
+struct ConcatIndexSequences<IndexSequence<First...>, IndexSequence<Second...> >
+{
+    typedef IndexSequence<First..., (sizeof...(First) + Second)...> Type;
+};
+
+/**
+ * Defines Type as IndexSequence<0, ..., N - 1>, with a recursion depth
+ * logarithmic in N so that large tables stay within the compiler limits
+ */
+template <int N>
+struct MakeIndexSequence
+{
+    typedef typename ConcatIndexSequences<
+        typename MakeIndexSequence<N / 2>::Type,
+        typename MakeIndexSequence<N - N / 2>::Type>::Type Type;
+};
+
+template <>
+struct MakeIndexSequence<0>
+{
+    typedef IndexSequence<> Type;
+};
+
+template <>
+struct MakeIndexSequence<1>
+{
+    typedef IndexSequence<0> Type;
+};
+
+template <int Level,
+          typename PointIndices =
+              typename MakeIndexSequence<3 * getNumPoints(Level)>::Type,
+          typename VertexIndices =
+              typename MakeIndexSequence<getNumVertices(Level)>::Type,
+          typename FaceIndices =
+              typename MakeIndexSequence<getNumFaces(Level) + 1>::Type>
+struct MeshTables;
+
+/**
+ * MeshTables
+ *
+ * The point, vertex list and start index tables of the level 'Level' mesh,
+ * evaluated at compile time, and thus stored in read-only memory.
+ */
+template <int Level, int... PointIndices, int... VertexIndices,
+          int... FaceIndices>
+struct MeshTables<Level, IndexSequence<PointIndices...>,
+                  IndexSequence<VertexIndices...>,
+                  IndexSequence<FaceIndices...> >
+{
+    static constexpr float s_points[] = {
+        getPointCoordinate(Level, PointIndices / 3, PointIndices % 3)... };
+    static constexpr int s_vertexList[] = {
+        getVertex(Level, VertexIndices)... };
+    static constexpr int s_startIndex[] = { getStartIndex(FaceIndices)... };
+};
+
+template <int Level, int... PointIndices, int... VertexIndices,
+          int... FaceIndices>
+constexpr float MeshTables<Level, IndexSequence<PointIndices...>,
+                           IndexSequence<VertexIndices...>,
+                           IndexSequence<FaceIndices...> >::s_points[];
+
+template <int Level, int... PointIndices, int... VertexIndices,
+          int... FaceIndices>
+constexpr int MeshTables<Level, IndexSequence<PointIndices...>,
+                         IndexSequence<VertexIndices...>,
+                         IndexSequence<FaceIndices...> >::s_vertexList[];
+
+template <int Level, int... PointIndices, int... VertexIndices,
+          int... FaceIndices>
+constexpr int MeshTables<Level, IndexSequence<PointIndices...>,
+                         IndexSequence<VertexIndices...>,
+                         IndexSequence<FaceIndices...> >::s_startIndex[];
+
+/**
+ * Points to the compile-time tables of a level, see getCompiledTables()
+ */
+struct CompiledTables
+{
+    const float *points;
+    const int *vertexList;
+    const int *startIndex;
+};
+
+template <int Level>
+CompiledTables makeCompiledTables()
+{
+    CompiledTables tables = {
+        MeshTables<Level>::s_points,
+        MeshTables<Level>::s_vertexList,
+        MeshTables<Level>::s_startIndex };
+    return tables;
+}
+
+/**
+ * Sets the given tables to the compile-time ones of the given level, if it
+ * has any, and returns whether it does
+ */
+inline bool getCompiledTables(int level, CompiledTables &tables)
+{
+    switch (level)
+    {
+    case 0: tables = makeCompiledTables<0>(); return true;
+    case 1: tables = makeCompiledTables<1>(); return true;
+    case 2: tables = makeCompiledTables<2>(); return true;
+    case 3: tables = makeCompiledTables<3>(); return true;
+    case 4: tables = makeCompiledTables<4>(); return true;
+    default: return false;
+    }
+}
+
+} // namespace topology
+
+} // namespace CubeMaker
+
+#endif // KATANAOPS_CUBEMAKERTOPOLOGY_H
@@ -1,10 +1,22 @@
-
 // Copyright (c) 2016 The Foundry Visionmongers, Ltd.
 #include <FnGeolib/op/FnGeolibOp.h>
 #include <FnAttribute/FnAttribute.h>
-#include <iostream>
+
+#include "OpLog.h"
+#include "OpStats.h"
+
 namespace
 {
+KatanaOps::OpLog g_log("HelloWorld");
+
+// The cook counters of the Op, which only has a single branch
+KatanaOps::OpStats& getStats()
+{
+    static const char *const s_branchNames[] = { "cook", 0 };
+    static KatanaOps::OpStats s_stats("HelloWorld", s_branchNames);
+    return s_stats;
+}
+
 // "Hello World"-style op that sets a string attribute at the root location.
 class HelloWorldOp : public Foundry::Katana::GeolibOp
 {
@@ -13,19 +25,27 @@ public:
     // concurrently.
     static void setup(Foundry::Katana::GeolibSetupInterface& interface)
     {
-        std::cerr << "AAAA - SETUP" << std::endl;
+        KATANAOPS_LOG_DEBUG(g_log, "setup");
         interface.setThreading(
             Foundry::Katana::GeolibSetupInterface::ThreadModeConcurrent);
     }
 
     static void cook(Foundry::Katana::GeolibCookInterface& interface)
     {
-        std::cerr << "AAAA - COOK" << std::endl;
-        if (interface.atRoot())
         {
-            interface.setAttr("hello", FnAttribute::StringAttribute("world!"));
+            KatanaOps::ScopedCookTimer timer(getStats(), 0);
+
+            KATANAOPS_LOG_DEBUG(g_log, "cook");
+            if (interface.atRoot())
+            {
+                const FnAttribute::StringAttribute helloAttr("world!");
+                interface.setAttr("hello", helloAttr);
+                getStats().addAttribute(helloAttr);
+            }
+            interface.stopChildTraversal();
         }
-        interface.stopChildTraversal();
+
+        KatanaOps::logReport(getStats(), g_log);
     }
 };
 
@@ -35,6 +55,5 @@ DEFINE_GEOLIBOP_PLUGIN(HelloWorldOp)
 void registerPlugins()
 {
     REGISTER_PLUGIN(HelloWorldOp, "HelloWorld", 1, 2);
-    std::cerr << "AAAA" << std::endl;
-        
+    KATANAOPS_LOG_DEBUG(g_log, "registered");
 }
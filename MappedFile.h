@@ -0,0 +1,395 @@
+#ifndef KATANAOPS_MAPPEDFILE_H
+#define KATANAOPS_MAPPEDFILE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace KatanaOps
+{
+
+/**
+ * FileIdentity
+ *
+ * Identifies the content of a file on disk: a file replaced, by a rename
+ * over it, or rewritten (its modification time or size changing), gets a
+ * new identity, while its path stays the same.
+ */
+struct FileIdentity
+{
+    FileIdentity() : device(0), inode(0), size(0), modificationTime(0) {}
+
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    /// In nanoseconds, where the file system records them
+    uint64_t modificationTime;
+
+    bool operator==(const FileIdentity &other) const
+    {
+        return device == other.device && inode == other.inode &&
+            size == other.size && modificationTime == other.modificationTime;
+    }
+    bool operator!=(const FileIdentity &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+#if defined(_WIN32)
+inline void getFileIdentity(const BY_HANDLE_FILE_INFORMATION &info,
+                            FileIdentity &identity)
+{
+    identity.device = info.dwVolumeSerialNumber;
+    identity.inode =
+        (static_cast<uint64_t>(info.nFileIndexHigh) << 32) |
+        info.nFileIndexLow;
+    identity.size =
+        (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    identity.modificationTime =
+        ((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+         info.ftLastWriteTime.dwLowDateTime) * 100;
+}
+#else
+inline void getFileIdentity(const struct stat &status, FileIdentity &identity)
+{
+    identity.device = static_cast<uint64_t>(status.st_dev);
+    identity.inode = static_cast<uint64_t>(status.st_ino);
+    identity.size = static_cast<uint64_t>(status.st_size);
+#if defined(__APPLE__)
+    const struct timespec &time = status.st_mtimespec;
+#else
+    const struct timespec &time = status.st_mtim;
+#endif
+    identity.modificationTime =
+        static_cast<uint64_t>(time.tv_sec) * 1000000000u +
+        static_cast<uint64_t>(time.tv_nsec);
+}
+#endif
+
+/**
+ * Reads the identity of the file of the given path, without opening it on
+ * POSIX, returns false, and sets 'error', if it can't be read
+ */
+inline bool getFileIdentity(const std::string &path, FileIdentity &identity,
+                            std::string &error)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), 0,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE |
+                              FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        error = "cannot open file";
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    const bool found = GetFileInformationByHandle(file, &info) != 0;
+    CloseHandle(file);
+    if (!found)
+    {
+        error = "cannot get file information";
+        return false;
+    }
+    getFileIdentity(info, identity);
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+    {
+        error = std::strerror(errno);
+        return false;
+    }
+    getFileIdentity(status, identity);
+#endif
+    return true;
+}
+
+/**
+ * Returns the name of the host, restricted to the characters safe in a file
+ * name, or "host" if it can't be queried
+ */
+inline std::string getHostName()
+{
+    char name[256] = {};
+#if defined(_WIN32)
+    DWORD length = sizeof(name);
+    if (!GetComputerNameA(name, &length))
+    {
+        name[0] = '\0';
+    }
+#else
+    if (gethostname(name, sizeof(name) - 1) != 0)
+    {
+        name[0] = '\0';
+    }
+#endif
+    std::string hostName;
+    for (const char *c = name; *c; ++c)
+    {
+        const bool safe = (*c >= 'a' && *c <= 'z') ||
+            (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+            *c == '-' || *c == '_';
+        hostName += safe ? *c : '_';
+    }
+    return hostName.empty() ? std::string("host") : hostName;
+}
+
+/**
+ * Creates, and opens for writing, a new file next to the given path, to
+ * write a file to before replaceFile() moves it to the given path. The file
+ * is created exclusively, under a name made of the host name, process ID
+ * and a counter: processes sharing a directory, on other hosts or with the
+ * same process ID in other containers, never write to the same temporary
+ * file, a name already taken being skipped. Returns a null pointer if the
+ * file can't be created, the path of the file otherwise.
+ */
+inline std::FILE* createTemporaryFile(const std::string &path,
+                                      std::string &temporaryPath)
+{
+    static const std::string s_hostName = getHostName();
+    static std::atomic<unsigned long> s_nextTemporary(0);
+#if defined(_WIN32)
+    const unsigned long processId = static_cast<unsigned long>(_getpid());
+#else
+    const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+    const std::string prefix = path + "." + s_hostName + "." +
+        std::to_string(processId) + ".";
+
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        temporaryPath = prefix +
+            std::to_string(s_nextTemporary.fetch_add(1)) + ".tmp";
+#if defined(_WIN32)
+        const int fd = _open(temporaryPath.c_str(),
+                             _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY,
+                             _S_IREAD | _S_IWRITE);
+#else
+        const int fd = open(temporaryPath.c_str(),
+                            O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+#endif
+        if (fd < 0)
+        {
+            if (errno == EEXIST)
+            {
+                continue;
+            }
+            return nullptr;
+        }
+#if defined(_WIN32)
+        std::FILE *file = _fdopen(fd, "wb");
+        if (!file)
+        {
+            _close(fd);
+        }
+#else
+        std::FILE *file = fdopen(fd, "wb");
+        if (!file)
+        {
+            close(fd);
+        }
+#endif
+        if (!file)
+        {
+            std::remove(temporaryPath.c_str());
+        }
+        return file;
+    }
+    return nullptr;
+}
+
+/**
+ * Renames the file of the first path to the second one, replacing it at
+ * once: processes opening the second path see either file, whole, and the
+ * ones that mapped the file replaced keep its content
+ */
+inline bool replaceFile(const std::string &from, const std::string &to)
+{
+#if defined(_WIN32)
+    // rename() doesn't replace existing files on Windows
+    return MoveFileExA(from.c_str(), to.c_str(),
+                       MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+/**
+ * MappedFile
+ *
+ * Read-only memory mapping of a whole file. Pages are only read from disk
+ * when first accessed, and can be dropped by the system under memory
+ * pressure, so that random access to a few records of a large file only
+ * costs the pages holding them.
+ *
+ * Mappings are shared with the file: a file truncated while mapped makes
+ * accessing its missing pages fail (SIGBUS on POSIX). Files meant to be
+ * mapped by other processes must be replaced, written to a temporary file
+ * renamed over them, rather than rewritten in place, the mapping keeping the
+ * content it was opened with. identity() tells whether a path still holds
+ * that content.
+ */
+class MappedFile
+{
+public:
+
+    MappedFile() : m_data(nullptr), m_size(0)
+#if defined(_WIN32)
+        , m_mapping(nullptr)
+#endif
+    {
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /**
+     * Maps the file of the given path, returns false, and sets 'error', if
+     * it can't be
+     */
+    bool open(const std::string &path, std::string &error)
+    {
+        close();
+
+#if defined(_WIN32)
+        // Sharing deletion lets the file be replaced while mapped
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            error = "cannot open file";
+            return false;
+        }
+
+        BY_HANDLE_FILE_INFORMATION info;
+        if (!GetFileInformationByHandle(file, &info))
+        {
+            CloseHandle(file);
+            error = "cannot get file information";
+            return false;
+        }
+        getFileIdentity(info, m_identity);
+        m_size = static_cast<size_t>(m_identity.size);
+        if (m_size > 0)
+        {
+            m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+                                           nullptr);
+            if (m_mapping)
+            {
+                m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+            }
+        }
+        CloseHandle(file);
+        if (m_size > 0 && !m_data)
+        {
+            close();
+            error = "cannot map file";
+            return false;
+        }
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            error = std::strerror(errno);
+            return false;
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            error = std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        getFileIdentity(status, m_identity);
+        m_size = static_cast<size_t>(status.st_size);
+        if (m_size > 0)
+        {
+            void *data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                error = std::strerror(errno);
+                ::close(fd);
+                m_size = 0;
+                return false;
+            }
+            m_data = data;
+        }
+        // The mapping stays valid once the descriptor is closed
+        ::close(fd);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+        }
+        m_mapping = nullptr;
+#else
+        if (m_data)
+        {
+            munmap(m_data, m_size);
+        }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+        m_identity = FileIdentity();
+    }
+
+    const void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    /**
+     * Returns the identity of the file mapped, as of when it was opened
+     */
+    const FileIdentity& identity() const { return m_identity; }
+
+private:
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    void *m_data;
+    size_t m_size;
+    FileIdentity m_identity;
+#if defined(_WIN32)
+    HANDLE m_mapping;
+#endif
+};
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_MAPPEDFILE_H
@@ -0,0 +1,332 @@
+#ifndef KATANAOPS_MEMORYREPORT_H
+#define KATANAOPS_MEMORYREPORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+#include <FnAttribute/FnGroupBuilder.h>
+
+#include "MockCookInterface.h"
+#include "OpStats.h"
+
+namespace KatanaOps
+{
+
+/**
+ * MemoryReport
+ *
+ * Estimates the memory held by the attributes of the locations an Op
+ * generates below a given one, by cooking them through MockCookInterface,
+ * outside of Geolib.
+ *
+ * The bytes of attribute data are totalled per category: the 'geometry',
+ * 'xform' and 'bound' attributes, the other attributes, and the Op
+ * arguments given to the children. Payloads, attributes or any of their
+ * children, are told apart by handle: one referenced by several locations
+ * is shared, and only counted once towards the resident bytes, while the
+ * others are unique to their location.
+ *
+ * At most 'maxLocations' locations, or about, are cooked: locations with
+ * more children than their share of that budget, or than
+ * kMaxSamplesPerLocation, only have an evenly spaced sample of them cooked,
+ * each one standing for the ones skipped around it, so that the report of a
+ * scene of any size is quick to build. Payloads only seen once are assumed
+ * to be unique to each location they stand for.
+ */
+class MemoryReport
+{
+public:
+
+    enum Category
+    {
+        kCategoryGeometry,
+        kCategoryXform,
+        kCategoryBound,
+        kCategoryOther,
+        kCategoryOpArgs,
+        kNumCategories
+    };
+
+    enum
+    {
+        kDefaultMaxLocations = 10000,
+        kMaxSamplesPerLocation = 32
+    };
+
+    explicit MemoryReport(size_t maxLocations = kDefaultMaxLocations)
+        : m_maxLocations(std::max<size_t>(maxLocations, 1)),
+          m_locations(0.0),
+          m_sampledLocations(0)
+    {
+    }
+
+    /**
+     * Cooks, with the given Op, the location of the given path, with the
+     * given arguments, and the locations below it, adding their attributes
+     * to the report
+     */
+    template <typename Op>
+    void walk(const FnAttribute::GroupAttribute &opArgs,
+              const std::string &path)
+    {
+        struct Entry
+        {
+            std::string path;
+            MockCookInterface::Child child;
+            double weight;
+            size_t budget;
+        };
+
+        Entry root;
+        root.path = path;
+        root.child.args = opArgs;
+        root.child.privateData = nullptr;
+        root.child.deletePrivateData = nullptr;
+        root.weight = 1.0;
+        root.budget = m_maxLocations;
+
+        std::vector<Entry> entries(1, root);
+        std::vector<MockCookInterface::Child> children;
+        while (!entries.empty())
+        {
+            const Entry entry = std::move(entries.back());
+            entries.pop_back();
+
+            children.clear();
+            {
+                MockCookInterface interface(entry.child.args, entry.path,
+                                            entry.child.privateData, true);
+                interface.recordAttrs();
+                Op::cookLocation(interface);
+                if (entry.child.deletePrivateData)
+                {
+                    entry.child.deletePrivateData(entry.child.privateData);
+                }
+
+                m_locations += entry.weight;
+                ++m_sampledLocations;
+                for (size_t i = 0; i < interface.getAttrs().size(); ++i)
+                {
+                    const std::pair<std::string,
+                                    FnAttribute::Attribute> &attr =
+                        interface.getAttrs()[i];
+                    addAttr(getCategory(attr.first), attr.second,
+                            entry.weight);
+                }
+                interface.takeChildren(children);
+            }
+
+            // Share the budget left between the sampled children, which
+            // always include at least one, so that the leaves are reached.
+            // Their arguments stand for the ones of the children skipped
+            const size_t numberOfChildren = children.size();
+            const size_t numberOfSamples = std::min<size_t>(
+                std::min<size_t>(numberOfChildren, kMaxSamplesPerLocation),
+                std::max<size_t>(entry.budget - 1, 1));
+            size_t nextSample = 0;
+            for (size_t i = 0; i < numberOfChildren; ++i)
+            {
+                const size_t sampleIndex =
+                    ((2 * nextSample + 1) * numberOfChildren) /
+                    (2 * numberOfSamples);
+                if (nextSample < numberOfSamples && i == sampleIndex)
+                {
+                    Entry childEntry;
+                    childEntry.path = entry.path + "/" + children[i].name;
+                    childEntry.child = children[i];
+                    childEntry.weight = entry.weight *
+                        static_cast<double>(numberOfChildren) /
+                        static_cast<double>(numberOfSamples);
+                    childEntry.budget = std::max<size_t>(
+                        (entry.budget - 1) / numberOfSamples, 1);
+                    addAttr(kCategoryOpArgs, childEntry.child.args,
+                            childEntry.weight);
+                    entries.push_back(childEntry);
+                    ++nextSample;
+                }
+                else if (children[i].deletePrivateData)
+                {
+                    children[i].deletePrivateData(children[i].privateData);
+                }
+            }
+        }
+    }
+
+    /**
+     * Returns a group attribute holding the estimates: the number of
+     * locations, and for each category the number of attributes set
+     * ('references'), their bytes if none were shared ('bytes') and the
+     * bytes actually held once shared payloads are only counted once
+     * ('residentBytes'), along with the totals
+     */
+    FnAttribute::GroupAttribute buildAttr() const
+    {
+        static const char *const s_categoryNames[kNumCategories] = {
+            "geometry", "xform", "bound", "other", "opArgs" };
+
+        double residentBytes[kNumCategories] = {};
+        double sharedPayloads = 0.0;
+        double uniquePayloads = 0.0;
+        for (PayloadMap::const_iterator it = m_payloads.begin();
+             it != m_payloads.end(); ++it)
+        {
+            const Payload &payload = it->second;
+            if (payload.isShared())
+            {
+                residentBytes[payload.category] += payload.bytes;
+                sharedPayloads += 1.0;
+            }
+            else
+            {
+                residentBytes[payload.category] +=
+                    payload.bytes * payload.weight;
+                uniquePayloads += payload.weight;
+            }
+        }
+
+        FnAttribute::GroupBuilder gb;
+        double totalBytes = 0.0;
+        double totalResidentBytes = 0.0;
+        for (int category = 0; category < kNumCategories; ++category)
+        {
+            const std::string prefix =
+                std::string("categories.") + s_categoryNames[category];
+            gb.set(prefix + ".references", FnAttribute::DoubleAttribute(
+                m_categories[category].references));
+            gb.set(prefix + ".bytes", FnAttribute::DoubleAttribute(
+                m_categories[category].bytes));
+            gb.set(prefix + ".residentBytes", FnAttribute::DoubleAttribute(
+                residentBytes[category]));
+            totalBytes += m_categories[category].bytes;
+            totalResidentBytes += residentBytes[category];
+        }
+        gb.set("locations", FnAttribute::DoubleAttribute(m_locations));
+        gb.set("sampledLocations", FnAttribute::DoubleAttribute(
+            static_cast<double>(m_sampledLocations)));
+        gb.set("sharedPayloads", FnAttribute::DoubleAttribute(sharedPayloads));
+        gb.set("uniquePayloads", FnAttribute::DoubleAttribute(uniquePayloads));
+        gb.set("bytes", FnAttribute::DoubleAttribute(totalBytes));
+        gb.set("residentBytes",
+               FnAttribute::DoubleAttribute(totalResidentBytes));
+        return gb.build();
+    }
+
+private:
+
+    struct Totals
+    {
+        double references;
+        double bytes;
+
+        Totals() : references(0.0), bytes(0.0) {}
+    };
+
+    struct Payload
+    {
+        // Keeps the handle from being reused by another attribute
+        FnAttribute::Attribute attr;
+        uint64_t bytes;
+        unsigned sightings;
+        double weight;
+        Category category;
+        // The payload it was first seen a child of, if any
+        const Payload *parent;
+
+        /**
+         * Returns whether the payload, or one holding it, has been seen more
+         * than once
+         */
+        bool isShared() const
+        {
+            for (const Payload *payload = this; payload;
+                 payload = payload->parent)
+            {
+                if (payload->sightings > 1)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    typedef std::map<const void*, Payload> PayloadMap;
+
+    static Category getCategory(const std::string &attrName)
+    {
+        if (attrName == "geometry")
+        {
+            return kCategoryGeometry;
+        }
+        if (attrName == "xform")
+        {
+            return kCategoryXform;
+        }
+        if (attrName == "bound")
+        {
+            return kCategoryBound;
+        }
+        return kCategoryOther;
+    }
+
+    void addAttr(Category category, const FnAttribute::Attribute &attr,
+                 double weight)
+    {
+        if (!attr.isValid())
+        {
+            return;
+        }
+        m_categories[category].references += weight;
+        m_categories[category].bytes +=
+            OpStats::getAttributeDataSize(attr) * weight;
+        addPayload(category, attr, weight, nullptr);
+    }
+
+    /**
+     * Records the given attribute and, unless already seen, its children,
+     * as payloads
+     */
+    void addPayload(Category category, const FnAttribute::Attribute &attr,
+                    double weight, const Payload *parent)
+    {
+        std::pair<PayloadMap::iterator, bool> inserted =
+            m_payloads.insert(std::make_pair(
+                static_cast<const void*>(attr.getHandle()), Payload()));
+        Payload &payload = inserted.first->second;
+        if (!inserted.second)
+        {
+            ++payload.sightings;
+            return;
+        }
+
+        FnAttribute::GroupAttribute groupAttr(attr);
+        payload.attr = attr;
+        payload.bytes =
+            groupAttr.isValid() ? 0 : OpStats::getAttributeDataSize(attr);
+        payload.sightings = 1;
+        payload.weight = weight;
+        payload.category = category;
+        payload.parent = parent;
+        for (int64_t i = 0; i < groupAttr.getNumberOfChildren(); ++i)
+        {
+            addPayload(category, groupAttr.getChildByIndex(i), weight,
+                       &payload);
+        }
+    }
+
+    const size_t m_maxLocations;
+    double m_locations;
+    size_t m_sampledLocations;
+    Totals m_categories[kNumCategories];
+    PayloadMap m_payloads;
+};
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_MEMORYREPORT_H
@@ -0,0 +1,206 @@
+#ifndef KATANAOPS_MOCKCOOKINTERFACE_H
+#define KATANAOPS_MOCKCOOKINTERFACE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+
+#include <FnGeolib/op/FnGeolibOp.h>
+
+namespace KatanaOps
+{
+
+/**
+ * MockCookInterface
+ *
+ * Provides the subset of the GeolibCookInterface used by the templated cook
+ * logic of the Ops, so that it can be driven without a Geolib runtime, by
+ * the benchmarks and the CubeMaker driver.
+ *
+ * The children and attributes created are counted. When asked to record
+ * the children, their names, arguments and private data are kept for the
+ * caller to cook them in turn, see takeChildren(), otherwise the private
+ * data is deleted right away, the children never being cooked. Attributes
+ * set can be kept as well, see recordAttrs().
+ */
+class MockCookInterface
+{
+public:
+
+    typedef Foundry::Katana::GeolibCookInterface::ResetRoot ResetRoot;
+
+    struct Child
+    {
+        std::string name;
+        FnAttribute::GroupAttribute args;
+        void *privateData;
+        void (*deletePrivateData)(void *data);
+    };
+
+    MockCookInterface(const FnAttribute::GroupAttribute &opArgs,
+                      const std::string &outputLocationPath,
+                      void *privateData = nullptr,
+                      bool recordChildren = false)
+        : m_opArgs(opArgs),
+          m_outputLocationPath(outputLocationPath),
+          m_privateData(privateData),
+          m_recordChildren(recordChildren),
+          m_recordAttrs(false),
+          m_numChildren(0),
+          m_numAttrs(0),
+          m_stoppedChildTraversal(false)
+    {
+    }
+
+    ~MockCookInterface()
+    {
+        for (size_t i = 0; i < m_children.size(); ++i)
+        {
+            if (m_children[i].deletePrivateData)
+            {
+                m_children[i].deletePrivateData(m_children[i].privateData);
+            }
+        }
+    }
+
+    bool atRoot() const
+    {
+        return m_outputLocationPath == "/root";
+    }
+
+    void stopChildTraversal()
+    {
+        m_stoppedChildTraversal = true;
+    }
+
+    FnAttribute::Attribute getOpArg(const std::string &specificArgName = "") const
+    {
+        if (specificArgName.empty())
+        {
+            return m_opArgs;
+        }
+        return m_opArgs.getChildByName(specificArgName);
+    }
+
+    void createChild(const std::string &name, const std::string &opType = "",
+                     const FnAttribute::Attribute &args = FnAttribute::Attribute(),
+                     ResetRoot resetRoot =
+                         Foundry::Katana::GeolibCookInterface::ResetRootAuto,
+                     void *privateData = nullptr,
+                     void (*deletePrivateData)(void *data) = nullptr)
+    {
+        ++m_numChildren;
+        if (m_recordChildren)
+        {
+            // Children without arguments of their own inherit the ones of
+            // their parent
+            Child child;
+            child.name = name;
+            child.args = args.isValid() ? FnAttribute::GroupAttribute(args) :
+                m_opArgs;
+            child.privateData = privateData;
+            child.deletePrivateData = deletePrivateData;
+            m_children.push_back(child);
+        }
+        else if (deletePrivateData)
+        {
+            deletePrivateData(privateData);
+        }
+    }
+
+    void setAttr(const std::string &attrName,
+                 const FnAttribute::Attribute &value,
+                 const bool groupInherit = true)
+    {
+        if (attrName == "errorMessage")
+        {
+            FnAttribute::StringAttribute messageAttr(value);
+            m_errorMessage = messageAttr.getValue(std::string(), false);
+        }
+        if (m_recordAttrs)
+        {
+            m_attrs.push_back(std::make_pair(attrName, value));
+        }
+        ++m_numAttrs;
+    }
+
+    std::string getOutputLocationPath() const
+    {
+        return m_outputLocationPath;
+    }
+
+    void* getPrivateData() const
+    {
+        return m_privateData;
+    }
+
+    long long getNumChildren() const { return m_numChildren; }
+    long long getNumAttrs() const { return m_numAttrs; }
+    bool stoppedChildTraversal() const { return m_stoppedChildTraversal; }
+    const std::string& getErrorMessage() const { return m_errorMessage; }
+
+    /**
+     * Makes the attributes set from now on kept, for getAttr() and
+     * getAttrs()
+     */
+    void recordAttrs() { m_recordAttrs = true; }
+
+    /**
+     * Returns the last recorded attribute of the given name, or an invalid
+     * attribute if none was set
+     */
+    FnAttribute::Attribute getAttr(const std::string &attrName) const
+    {
+        for (size_t i = m_attrs.size(); i > 0; --i)
+        {
+            if (m_attrs[i - 1].first == attrName)
+            {
+                return m_attrs[i - 1].second;
+            }
+        }
+        return FnAttribute::Attribute();
+    }
+
+    const std::vector<std::pair<std::string, FnAttribute::Attribute> >&
+    getAttrs() const
+    {
+        return m_attrs;
+    }
+
+    /**
+     * Appends the recorded children, and hands the ownership of their
+     * private data over, to the given vector
+     */
+    void takeChildren(std::vector<Child> &children)
+    {
+        children.insert(children.end(), m_children.begin(), m_children.end());
+        m_children.clear();
+    }
+
+private:
+
+    FnAttribute::GroupAttribute m_opArgs;
+    std::string m_outputLocationPath;
+    void *m_privateData;
+    bool m_recordChildren;
+    bool m_recordAttrs;
+    long long m_numChildren;
+    long long m_numAttrs;
+    bool m_stoppedChildTraversal;
+    std::string m_errorMessage;
+    std::vector<Child> m_children;
+    std::vector<std::pair<std::string, FnAttribute::Attribute> > m_attrs;
+};
+
+inline void ReportError(MockCookInterface &interface,
+                        const std::string &message)
+{
+    interface.setAttr("type", FnAttribute::StringAttribute("error"));
+    interface.setAttr("errorMessage", FnAttribute::StringAttribute(message));
+}
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_MOCKCOOKINTERFACE_H
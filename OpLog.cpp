@@ -0,0 +1,239 @@
+#include "OpLog.h"
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <FnLogging/FnLogging.h>
+
+namespace KatanaOps
+{
+
+namespace { //anonymous
+
+/**
+ * LogDrain
+ *
+ * Owns the rings of all the threads that have logged a message and a thread
+ * forwarding their records to Katana's logging whenever some are waiting.
+ * There is a single instance per plug-in, see getDrain().
+ */
+class LogDrain
+{
+public:
+
+    LogDrain() : m_stopping(false), m_pending(false) {}
+
+    LogRing* getThreadRing()
+    {
+        struct ThreadRing
+        {
+            explicit ThreadRing(LogDrain &drain) : ring(drain.addRing()) {}
+            ~ThreadRing()
+            {
+                if (ring)
+                {
+                    ring->setOrphaned();
+                }
+            }
+
+            std::shared_ptr<LogRing> ring;
+        };
+
+        static thread_local ThreadRing s_threadRing(*this);
+        return s_threadRing.ring.get();
+    }
+
+    /**
+     * Wakes up the draining thread, unless it has already been since it
+     * last drained the rings, so that the mutex is only taken once per
+     * drain whatever the number of records
+     */
+    void notify()
+    {
+        if (!m_pending.load(std::memory_order_relaxed) &&
+            !m_pending.exchange(true))
+        {
+            // Notifying under the mutex, the thread can't miss it between
+            // checking m_pending and waiting
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_condition.notify_one();
+        }
+    }
+
+    /**
+     * Stops, and joins, the draining thread, without forwarding the records
+     * left, and has the threads logging from now on drop their messages
+     */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_one();
+        if (m_thread.joinable() &&
+            m_thread.get_id() != std::this_thread::get_id())
+        {
+            m_thread.join();
+        }
+    }
+
+    void drainAll()
+    {
+        std::vector<std::shared_ptr<LogRing> > rings;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            rings = m_rings;
+        }
+
+        // The rings have a single reader, the draining thread or a flush
+        std::lock_guard<std::mutex> drainLock(m_drainMutex);
+        for (size_t i = 0; i < rings.size(); ++i)
+        {
+            LogRing &ring = *rings[i];
+            ring.drain([this](const LogRing::Record &record) {
+                forward(record.module, record.level, record.message);
+            });
+
+            const unsigned int dropped = ring.takeDropped();
+            if (dropped > 0)
+            {
+                char message[64];
+                std::snprintf(message, sizeof(message),
+                              "%u log messages dropped", dropped);
+                forward("KatanaOps", kLogLevelWarning, message);
+            }
+        }
+
+        // Forget about the rings of the threads that have exited, once they
+        // have been fully drained
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_rings.size();)
+        {
+            if (m_rings[i]->isOrphaned() && m_rings[i]->isEmpty())
+            {
+                m_rings.erase(m_rings.begin() + i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+private:
+
+    LogDrain(const LogDrain&);
+    LogDrain& operator=(const LogDrain&);
+
+    std::shared_ptr<LogRing> addRing()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+        {
+            return std::shared_ptr<LogRing>();
+        }
+        std::shared_ptr<LogRing> ring = std::make_shared<LogRing>();
+        m_rings.push_back(ring);
+        if (!m_thread.joinable())
+        {
+            m_thread = std::thread(&LogDrain::run, this);
+        }
+        return ring;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_condition.wait(lock, [this]() {
+                return m_stopping || m_pending.load();
+            });
+            if (m_stopping)
+            {
+                return;
+            }
+            // Cleared first, so that the records written while draining
+            // wake the thread up again
+            m_pending.store(false);
+            lock.unlock();
+            drainAll();
+            lock.lock();
+        }
+    }
+
+    void forward(const char *module, int level, const char *message)
+    {
+        std::map<std::string, FnLogging::FnLog>::iterator it =
+            m_logs.find(module);
+        if (it == m_logs.end())
+        {
+            it = m_logs.insert(
+                std::make_pair(module, FnLogging::FnLog(module))).first;
+        }
+
+        switch (level)
+        {
+        case kLogLevelDebug: it->second.debug(message); break;
+        case kLogLevelInfo: it->second.info(message); break;
+        case kLogLevelWarning: it->second.warning(message); break;
+        default: it->second.error(message); break;
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<std::shared_ptr<LogRing> > m_rings;
+    std::thread m_thread;
+    bool m_stopping;
+    std::atomic<bool> m_pending;
+
+    // Held while reading the rings
+    std::mutex m_drainMutex;
+    std::map<std::string, FnLogging::FnLog> m_logs;
+};
+
+LogDrain& getDrain()
+{
+    // Never destroyed, as threads may log up to the unloading of the
+    // plug-in, and its loggers are never released, as Katana's logging may
+    // be gone by then
+    static LogDrain *s_drain = new LogDrain;
+    return *s_drain;
+}
+
+/**
+ * Stops the draining thread when the plug-in is unloaded, or the process
+ * exits, before the threads are torn down
+ */
+struct LogDrainStopper
+{
+    ~LogDrainStopper() { getDrain().stop(); }
+};
+
+LogDrainStopper g_logDrainStopper;
+
+} // anonymous
+
+LogRing* getThreadLogRing()
+{
+    return getDrain().getThreadRing();
+}
+
+void notifyLogDrain()
+{
+    getDrain().notify();
+}
+
+void flushLog()
+{
+    getDrain().drainAll();
+}
+
+} // namespace KatanaOps
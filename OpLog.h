@@ -0,0 +1,276 @@
+#ifndef KATANAOPS_OPLOG_H
+#define KATANAOPS_OPLOG_H
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "OpStats.h"
+
+/**
+ * The lowest level of the messages compiled in, messages below it are
+ * removed at compile time. Defaults to debug, so that all the messages can be
+ * enabled at runtime, see KatanaOps::OpLog.
+ */
+#ifndef KATANAOPS_LOG_MIN_LEVEL
+#define KATANAOPS_LOG_MIN_LEVEL 0
+#endif
+
+/**
+ * Logs a printf-style message at the given level to the given OpLog. The
+ * arguments are only evaluated if the level is both compiled in and enabled
+ * at runtime.
+ */
+#define KATANAOPS_LOG(log, level, ...)                                        \
+    do                                                                        \
+    {                                                                         \
+        if ((level) >= KATANAOPS_LOG_MIN_LEVEL && (log).isEnabled(level))     \
+        {                                                                     \
+            (log).write((level), __VA_ARGS__);                                \
+        }                                                                     \
+    }                                                                         \
+    while (0)
+
+#define KATANAOPS_LOG_DEBUG(log, ...)                                         \
+    KATANAOPS_LOG(log, KatanaOps::kLogLevelDebug, __VA_ARGS__)
+#define KATANAOPS_LOG_INFO(log, ...)                                          \
+    KATANAOPS_LOG(log, KatanaOps::kLogLevelInfo, __VA_ARGS__)
+#define KATANAOPS_LOG_WARNING(log, ...)                                       \
+    KATANAOPS_LOG(log, KatanaOps::kLogLevelWarning, __VA_ARGS__)
+#define KATANAOPS_LOG_ERROR(log, ...)                                         \
+    KATANAOPS_LOG(log, KatanaOps::kLogLevelError, __VA_ARGS__)
+
+namespace KatanaOps
+{
+
+enum LogLevel
+{
+    kLogLevelDebug = 0,
+    kLogLevelInfo = 1,
+    kLogLevelWarning = 2,
+    kLogLevelError = 3,
+    kLogLevelOff = 4
+};
+
+/**
+ * LogRing
+ *
+ * Fixed-size single-producer, single-consumer queue of log records, written
+ * by one cook thread and read by the draining thread without locking.
+ */
+class LogRing
+{
+public:
+
+    enum { kCapacity = 256, kModuleLength = 32, kMessageLength = 240 };
+
+    /// The module name is copied, so that records outlive the module
+    struct Record
+    {
+        char module[kModuleLength];
+        int level;
+        char message[kMessageLength];
+    };
+
+    LogRing() : m_head(0), m_tail(0), m_dropped(0), m_orphaned(false) {}
+
+    /**
+     * Returns the slot to write the next record into, or nullptr if the
+     * queue is full, in which case the record is counted as dropped
+     */
+    Record* beginWrite()
+    {
+        const unsigned int head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == kCapacity)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &m_records[head % kCapacity];
+    }
+
+    void endWrite()
+    {
+        m_head.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * Calls the given function with each record written since the last call
+     */
+    template <typename Function>
+    void drain(Function function)
+    {
+        unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        const unsigned int head = m_head.load(std::memory_order_acquire);
+        while (tail != head)
+        {
+            function(m_records[tail % kCapacity]);
+            ++tail;
+            m_tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    unsigned int takeDropped()
+    {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.load(std::memory_order_acquire) ==
+            m_tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Marks the ring as no longer written to, as its thread has exited
+     */
+    void setOrphaned() { m_orphaned.store(true, std::memory_order_release); }
+    bool isOrphaned() const { return m_orphaned.load(std::memory_order_acquire); }
+
+private:
+
+    Record m_records[kCapacity];
+    std::atomic<unsigned int> m_head;
+    std::atomic<unsigned int> m_tail;
+    std::atomic<unsigned int> m_dropped;
+    std::atomic<bool> m_orphaned;
+};
+
+/**
+ * Returns the ring of the calling thread, creating it, and starting the
+ * thread draining the rings of the plug-in, on first use, or nullptr once
+ * the drain has been stopped. See OpLog.cpp.
+ */
+LogRing* getThreadLogRing();
+
+/**
+ * Wakes up the draining thread, once records are waiting in a ring
+ */
+void notifyLogDrain();
+
+/**
+ * Forwards the records logged so far by all the threads to Katana's
+ * logging, from the calling thread. Messages still waiting when the plug-in
+ * is unloaded, or the process exits, are dropped rather than forwarded, as
+ * Katana's logging may be gone by then: call this from an explicit shutdown
+ * hook, while it is still up, to have them appear.
+ */
+void flushLog();
+
+/**
+ * OpLog
+ *
+ * Logging facility for the Ops in this repository, meant to be used through
+ * the KATANAOPS_LOG_* macros.
+ *
+ * Messages are gated twice: at compile time by KATANAOPS_LOG_MIN_LEVEL, and
+ * at runtime by the KATANAOPS_LOG_LEVEL environment variable ('debug',
+ * 'info', 'warning' (default), 'error' or 'off'). Messages that pass are
+ * formatted into a per-thread ring buffer, without locking or allocating,
+ * and forwarded asynchronously to Katana's logging, under the given module
+ * name, by a background thread. Messages are dropped, and counted, when a
+ * thread logs faster than the buffer is drained.
+ *
+ * The draining thread, and the rings, live in OpLog.cpp, which each plug-in
+ * links once (through the KatanaOpsLog library), so that a plug-in has a
+ * single drain whatever the number of its translation units logging. The
+ * thread only wakes up when records are waiting.
+ */
+class OpLog
+{
+public:
+
+    /**
+     * Creates a log for the given module name, which must outlive it
+     */
+    explicit OpLog(const char *module) : m_module(module) {}
+
+    bool isEnabled(int level) const
+    {
+        return level >= getRuntimeLevel();
+    }
+
+    void write(int level, const char *format, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 3, 4)))
+#endif
+    {
+        LogRing *ring = getThreadLogRing();
+        LogRing::Record *record = ring ? ring->beginWrite() : nullptr;
+        if (!record)
+        {
+            return;
+        }
+
+        std::snprintf(record->module, sizeof(record->module), "%s",
+                      m_module);
+        record->level = level;
+
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(record->message, sizeof(record->message), format, args);
+        va_end(args);
+
+        ring->endWrite();
+        notifyLogDrain();
+    }
+
+    /**
+     * Returns the lowest level of the messages enabled at runtime
+     */
+    static int getRuntimeLevel()
+    {
+        static const int s_level = readRuntimeLevel();
+        return s_level;
+    }
+
+private:
+
+    static int readRuntimeLevel()
+    {
+        const char *value = std::getenv("KATANAOPS_LOG_LEVEL");
+        if (!value)
+        {
+            return kLogLevelWarning;
+        }
+
+        static const char *const s_names[] = {
+            "debug", "info", "warning", "error", "off" };
+        for (int level = kLogLevelDebug; level <= kLogLevelOff; ++level)
+        {
+            if (std::strcmp(value, s_names[level]) == 0)
+            {
+                return level;
+            }
+        }
+        return kLogLevelWarning;
+    }
+
+    const char *m_module;
+};
+
+/**
+ * Logs the summary of the given cook counters to the given log when a
+ * report is due, see OpStats::takeReport(). Meant to be called at the end of
+ * each cook. The report is logged at the warning level whatever the runtime
+ * level of the log, as it was asked for by KATANAOPS_STATS.
+ */
+inline void logReport(OpStats &stats, OpLog &log)
+{
+    std::vector<std::string> lines;
+    if (stats.takeReport(lines))
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            log.write(kLogLevelWarning, "%s", lines[i].c_str());
+        }
+    }
+}
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_OPLOG_H
@@ -0,0 +1,321 @@
+#ifndef KATANAOPS_OPSTATS_H
+#define KATANAOPS_OPSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <FnAttribute/FnAttribute.h>
+
+namespace KatanaOps
+{
+
+/**
+ * OpStats
+ *
+ * Low-overhead cook counters shared by the Ops in this repository.
+ *
+ * Each Op keeps one OpStats instance, recording for each of its branches the
+ * number of cooks and the total and maximum cook time, along with the number
+ * of child locations created and the number of bytes of attribute data
+ * produced. Counters are only updated when the KATANAOPS_STATS environment
+ * variable is set to a non-zero value, so that they cost a single branch
+ * otherwise. All the counters are atomic, as cooks run concurrently.
+ *
+ * The values can be retrieved as a human readable summary, see format(),
+ * which the Ops log every KATANAOPS_STATS_INTERVAL seconds (10 by default),
+ * see takeReport() and logReport() in OpLog.h. They are deliberately kept
+ * out of the scene graph, whose cooks only depend on the Op arguments.
+ */
+class OpStats
+{
+public:
+
+    enum { kMaxBranches = 8 };
+
+    /**
+     * Creates the counters for the given Op, the names of its branches are
+     * given as a null-terminated array of at most kMaxBranches strings
+     */
+    OpStats(const char *opName, const char *const *branchNames)
+        : m_opName(opName),
+          m_numBranches(0),
+          m_childrenCreated(0),
+          m_attributeBytes(0),
+          m_nextReportTime(0),
+          m_reportedCooks(0)
+    {
+        while (m_numBranches < kMaxBranches && branchNames[m_numBranches])
+        {
+            m_branches[m_numBranches].name = branchNames[m_numBranches];
+            ++m_numBranches;
+        }
+    }
+
+    /**
+     * Returns whether the counters should be updated, as specified by the
+     * KATANAOPS_STATS environment variable
+     */
+    static bool enabled()
+    {
+        static const bool s_enabled = readEnabled();
+        return s_enabled;
+    }
+
+    const char* getOpName() const { return m_opName; }
+
+    void recordCook(int branch, uint64_t nanoseconds)
+    {
+        Branch &counters = m_branches[branch];
+        ++counters.cooks;
+        counters.totalTime += nanoseconds;
+
+        uint64_t maxTime = counters.maxTime.load(std::memory_order_relaxed);
+        while (nanoseconds > maxTime &&
+               !counters.maxTime.compare_exchange_weak(
+                   maxTime, nanoseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void addChildren(uint64_t numChildren)
+    {
+        if (enabled())
+        {
+            m_childrenCreated += numChildren;
+        }
+    }
+
+    void addAttribute(const FnAttribute::Attribute &attr)
+    {
+        if (enabled())
+        {
+            m_attributeBytes += getAttributeDataSize(attr);
+        }
+    }
+
+    /**
+     * Returns a human readable summary of the counters, as a line for each
+     * branch cooked and a line of totals, each one short enough for a log
+     * record
+     */
+    std::vector<std::string> format() const
+    {
+        std::vector<std::string> lines;
+        for (int i = 0; i < m_numBranches; ++i)
+        {
+            const Branch &counters = m_branches[i];
+            if (counters.cooks.load() == 0)
+            {
+                continue;
+            }
+            std::ostringstream ss;
+            ss << m_opName << " stats: " << counters.name
+               << " cooks=" << counters.cooks.load()
+               << " total=" << toMilliseconds(counters.totalTime.load())
+               << "ms max=" << toMilliseconds(counters.maxTime.load())
+               << "ms";
+            lines.push_back(ss.str());
+        }
+        std::ostringstream ss;
+        ss << m_opName << " stats: children=" << m_childrenCreated.load()
+           << " attributeBytes=" << m_attributeBytes.load();
+        lines.push_back(ss.str());
+        return lines;
+    }
+
+    /**
+     * Returns true, and sets 'lines' to the summary of the counters, see
+     * format(), if they are enabled, have changed, and haven't been
+     * reported over the last KATANAOPS_STATS_INTERVAL seconds. Meant to be
+     * called at the end of each cook, the counters of the last cooks of a
+     * burst being reported by the first cook after the interval.
+     */
+    bool takeReport(std::vector<std::string> &lines)
+    {
+        if (!enabled())
+        {
+            return false;
+        }
+        const int64_t now = static_cast<int64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        int64_t nextReportTime =
+            m_nextReportTime.load(std::memory_order_relaxed);
+        if (now < nextReportTime)
+        {
+            return false;
+        }
+        // A single cook takes each report
+        if (!m_nextReportTime.compare_exchange_strong(
+                nextReportTime, now + getReportInterval(),
+                std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        uint64_t cooks = 0;
+        for (int i = 0; i < m_numBranches; ++i)
+        {
+            cooks += m_branches[i].cooks.load();
+        }
+        if (m_reportedCooks.exchange(cooks) == cooks)
+        {
+            return false;
+        }
+        lines = format();
+        return true;
+    }
+
+    /**
+     * Returns the number of bytes held by the values of the given
+     * attribute, including all its time samples, and recursively by the
+     * children of group attributes
+     */
+    static uint64_t getAttributeDataSize(const FnAttribute::Attribute &attr)
+    {
+        switch (attr.getType())
+        {
+        case kFnKatAttributeTypeInt:
+            return getDataSize<FnAttribute::IntAttribute>(attr);
+        case kFnKatAttributeTypeFloat:
+            return getDataSize<FnAttribute::FloatAttribute>(attr);
+        case kFnKatAttributeTypeDouble:
+            return getDataSize<FnAttribute::DoubleAttribute>(attr);
+        case kFnKatAttributeTypeString:
+        {
+            FnAttribute::StringAttribute stringAttr(attr);
+            FnAttribute::StringConstVector values =
+                stringAttr.getNearestSample(0.0f);
+            uint64_t size = 0;
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                size += std::strlen(values[i]) + 1;
+            }
+            return size;
+        }
+        case kFnKatAttributeTypeGroup:
+        {
+            FnAttribute::GroupAttribute groupAttr(attr);
+            uint64_t size = 0;
+            for (int64_t i = 0; i < groupAttr.getNumberOfChildren(); ++i)
+            {
+                size += getAttributeDataSize(groupAttr.getChildByIndex(i));
+            }
+            return size;
+        }
+        default:
+            return 0;
+        }
+    }
+
+private:
+
+    struct Branch
+    {
+        Branch() : name(""), cooks(0), totalTime(0), maxTime(0) {}
+
+        const char *name;
+        std::atomic<uint64_t> cooks;
+        std::atomic<uint64_t> totalTime;
+        std::atomic<uint64_t> maxTime;
+    };
+
+    static bool readEnabled()
+    {
+        const char *value = std::getenv("KATANAOPS_STATS");
+        return value && *value && std::strcmp(value, "0") != 0;
+    }
+
+    /**
+     * Returns the interval between two reports, in nanoseconds, as
+     * specified by the KATANAOPS_STATS_INTERVAL environment variable
+     */
+    static int64_t getReportInterval()
+    {
+        static const int64_t s_interval = readReportInterval();
+        return s_interval;
+    }
+
+    static int64_t readReportInterval()
+    {
+        const char *value = std::getenv("KATANAOPS_STATS_INTERVAL");
+        const double seconds = value ? std::atof(value) : 0.0;
+        return static_cast<int64_t>((seconds > 0.0 ? seconds : 10.0) * 1e9);
+    }
+
+    template <typename DataAttributeType>
+    static uint64_t getDataSize(const FnAttribute::Attribute &attr)
+    {
+        DataAttributeType dataAttr(attr);
+        return static_cast<uint64_t>(dataAttr.getNumberOfValues()) *
+            static_cast<uint64_t>(dataAttr.getNumberOfTimeSamples()) *
+            sizeof(typename DataAttributeType::value_type);
+    }
+
+    static double toMilliseconds(uint64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) * 1e-6;
+    }
+
+    const char *m_opName;
+    int m_numBranches;
+    Branch m_branches[kMaxBranches];
+    std::atomic<uint64_t> m_childrenCreated;
+    std::atomic<uint64_t> m_attributeBytes;
+    std::atomic<int64_t> m_nextReportTime;
+    std::atomic<uint64_t> m_reportedCooks;
+};
+
+/**
+ * ScopedCookTimer
+ *
+ * Records the duration of its own lifetime as a cook of the given branch,
+ * if the counters are enabled.
+ */
+class ScopedCookTimer
+{
+public:
+
+    ScopedCookTimer(OpStats &stats, int branch)
+        : m_stats(stats), m_branch(branch), m_enabled(OpStats::enabled())
+    {
+        if (m_enabled)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedCookTimer()
+    {
+        if (m_enabled)
+        {
+            const std::chrono::steady_clock::duration elapsed =
+                std::chrono::steady_clock::now() - m_start;
+            m_stats.recordCook(
+                m_branch,
+                static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        elapsed).count()));
+        }
+    }
+
+private:
+
+    ScopedCookTimer(const ScopedCookTimer&);
+    ScopedCookTimer& operator=(const ScopedCookTimer&);
+
+    OpStats &m_stats;
+    const int m_branch;
+    const bool m_enabled;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_OPSTATS_H
@@ -0,0 +1,336 @@
+#ifndef KATANAOPS_PARALLEL_H
+#define KATANAOPS_PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+
+/**
+ * Whether the parallel loops run on the TBB work-stealing scheduler, which
+ * Katana ships and shares with its own cooks. Defaults to off, in which case
+ * the loops run on a pool of threads shared by all the loops, see
+ * ThreadPool.
+ */
+#ifndef KATANAOPS_HAVE_TBB
+#define KATANAOPS_HAVE_TBB 0
+#endif
+
+#if KATANAOPS_HAVE_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#else
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#endif
+
+namespace KatanaOps
+{
+
+/**
+ * Returns the largest number of threads a parallel loop runs on, given by
+ * the KATANAOPS_THREADS environment variable, defaulting to the number of
+ * hardware threads. Setting it to 1 runs all the loops serially.
+ */
+inline unsigned getMaxThreads()
+{
+    static const unsigned s_maxThreads = []()
+    {
+        if (const char *value = std::getenv("KATANAOPS_THREADS"))
+        {
+            const int threads = std::atoi(value);
+            if (threads > 0)
+            {
+                return static_cast<unsigned>(threads);
+            }
+        }
+#if KATANAOPS_HAVE_TBB
+        return static_cast<unsigned>(
+            tbb::this_task_arena::max_concurrency());
+#else
+        return std::max(std::thread::hardware_concurrency(), 1u);
+#endif
+    }();
+    return s_maxThreads;
+}
+
+#if !KATANAOPS_HAVE_TBB
+
+/**
+ * ThreadPool
+ *
+ * The threads the parallel loops run on without TBB, getMaxThreads() - 1 of
+ * them, started on first use and shared by all the loops of the process, so
+ * that concurrent cooks each running loops don't start threads of their
+ * own. Each loop is a Job, whose chunks are run by the thread calling it,
+ * and by the pool threads as they become free, up to as many threads in
+ * all as the job allows, so that the loops of concurrent cooks share the
+ * pool rather than multiply the threads, and loops within loops don't wait
+ * for threads busy on their parent.
+ */
+class ThreadPool
+{
+public:
+
+    class Job
+    {
+    public:
+
+        explicit Job(unsigned maxThreads)
+            : m_maxWorkers(maxThreads - 1), m_workers(0)
+        {
+        }
+
+        virtual ~Job() {}
+
+        /**
+         * Runs chunks of the job until there are none left
+         */
+        virtual void runChunks() = 0;
+
+    private:
+
+        friend class ThreadPool;
+
+        /// Pool threads allowed to help, and helping, guarded by the pool
+        const unsigned m_maxWorkers;
+        unsigned m_workers;
+    };
+
+    static ThreadPool& get()
+    {
+        static ThreadPool s_pool(getMaxThreads() - 1);
+        return s_pool;
+    }
+
+    /**
+     * Runs the given job, on the calling thread and the free pool threads,
+     * and returns once all its chunks have run
+     */
+    void run(Job &job)
+    {
+        if (job.m_maxWorkers > 0 && !m_threads.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobs.push_back(&job);
+            }
+            m_jobAdded.notify_all();
+        }
+        job.runChunks();
+
+        // No pool thread picks the job up once removed, wait for the ones
+        // still running its last chunks
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_jobs.size(); ++i)
+        {
+            if (m_jobs[i] == &job)
+            {
+                m_jobs.erase(m_jobs.begin() + i);
+                break;
+            }
+        }
+        m_jobDone.wait(lock, [&job]() { return job.m_workers == 0; });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobAdded.notify_all();
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i].join();
+        }
+    }
+
+private:
+
+    explicit ThreadPool(unsigned numberOfThreads) : m_stopping(false)
+    {
+        m_threads.reserve(numberOfThreads);
+        for (unsigned i = 0; i < numberOfThreads; ++i)
+        {
+            // Run on the threads started so far when no more can be
+            try
+            {
+                m_threads.emplace_back(&ThreadPool::work, this);
+            }
+            catch (const std::system_error&)
+            {
+                break;
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    /**
+     * Returns the oldest job accepting one more pool thread, or null
+     */
+    Job* findJob() const
+    {
+        for (size_t i = 0; i < m_jobs.size(); ++i)
+        {
+            if (m_jobs[i]->m_workers < m_jobs[i]->m_maxWorkers)
+            {
+                return m_jobs[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            Job *job = nullptr;
+            m_jobAdded.wait(lock, [this, &job]()
+            {
+                job = findJob();
+                return m_stopping || job;
+            });
+            if (m_stopping)
+            {
+                return;
+            }
+
+            ++job->m_workers;
+            lock.unlock();
+            job->runChunks();
+            lock.lock();
+            if (--job->m_workers == 0)
+            {
+                m_jobDone.notify_all();
+            }
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobAdded;
+    std::condition_variable m_jobDone;
+    std::vector<Job*> m_jobs;
+    std::vector<std::thread> m_threads;
+    bool m_stopping;
+};
+
+#endif
+
+/**
+ * Calls the given function, as function(chunkBegin, chunkEnd), on chunks of
+ * at least 'grainSize' elements covering [begin, end), concurrently.
+ *
+ * The chunks are disjoint, so that functions writing the results of each
+ * element at its own position build the same output, whatever the number of
+ * threads and however the chunks are scheduled. Ranges of less than two
+ * chunks are run inline, on the calling thread, as is everything when a
+ * single thread is allowed. The function must not call into Geolib, whose
+ * cook interface is only usable from the cooking thread.
+ */
+template <typename Function>
+void parallelFor(size_t begin, size_t end, size_t grainSize,
+                 const Function &function)
+{
+    grainSize = std::max<size_t>(grainSize, 1);
+    const unsigned maxThreads = getMaxThreads();
+    if (end <= begin || end - begin < 2 * grainSize || maxThreads <= 1)
+    {
+        if (begin < end)
+        {
+            function(begin, end);
+        }
+        return;
+    }
+
+#if KATANAOPS_HAVE_TBB
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(begin, end, grainSize),
+        [&function](const tbb::blocked_range<size_t> &range)
+        {
+            function(range.begin(), range.end());
+        });
+#else
+    // Chunks are handed out from a shared counter, so that faster threads
+    // pick up more of them, the calling thread taking part
+    class LoopJob : public ThreadPool::Job
+    {
+    public:
+
+        LoopJob(size_t begin, size_t end, size_t grainSize,
+                unsigned maxThreads, const Function &function)
+            : ThreadPool::Job(maxThreads),
+              m_begin(begin),
+              m_end(end),
+              m_grainSize(grainSize),
+              m_numberOfChunks((end - begin + grainSize - 1) / grainSize),
+              m_function(function),
+              m_nextChunk(0),
+              m_failed(false)
+        {
+        }
+
+        void runChunks()
+        {
+            for (size_t chunk = m_nextChunk++; chunk < m_numberOfChunks;
+                 chunk = m_nextChunk++)
+            {
+                const size_t chunkBegin = m_begin + chunk * m_grainSize;
+                try
+                {
+                    m_function(chunkBegin,
+                               std::min(chunkBegin + m_grainSize, m_end));
+                }
+                catch (...)
+                {
+                    // Keep the first error, and stop handing out chunks
+                    if (!m_failed.exchange(true))
+                    {
+                        m_error = std::current_exception();
+                    }
+                    m_nextChunk = m_numberOfChunks;
+                }
+            }
+        }
+
+        void rethrow() const
+        {
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+        }
+
+    private:
+
+        const size_t m_begin;
+        const size_t m_end;
+        const size_t m_grainSize;
+        const size_t m_numberOfChunks;
+        const Function &m_function;
+        std::atomic<size_t> m_nextChunk;
+        std::atomic<bool> m_failed;
+        std::exception_ptr m_error;
+    };
+
+    const size_t numberOfChunks = (end - begin + grainSize - 1) / grainSize;
+    LoopJob job(begin, end, grainSize,
+                static_cast<unsigned>(
+                    std::min<size_t>(maxThreads, numberOfChunks)),
+                function);
+    ThreadPool::get().run(job);
+    job.rethrow();
+#endif
+}
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_PARALLEL_H
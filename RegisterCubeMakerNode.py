@@ -8,9 +8,21 @@ def registerCubeMaker():
     Registers a new CubMaker node type using the NodeTypeBuilder utility class.
     """
 
+    import os
+    from collections import OrderedDict
+
     from Katana import Nodes3DAPI
     from Katana import FnAttribute
 
+    # The Op arguments built for the maxCachedOpArgs sets of parameter values
+    # most recently used, least recently used first, so that evaluating a
+    # node again, at another frame while scrubbing for example, hands the Op
+    # chain the same attribute when none of the values the arguments depend
+    # on changed. The parameters are still evaluated each time, to build the
+    # key, only building the attribute again is avoided
+    opArgsCache = OrderedDict()
+    maxCachedOpArgs = 256
+
     def buildCubeMakerOpChain(node, interface):
         """
         Defines the callback function used to create the Ops chain for the
@@ -28,37 +40,165 @@ def registerCubeMaker():
         # Set the minimum number of input ports
         interface.setMinRequiredInputs(0)
 
-        argsGb = FnAttribute.GroupBuilder()
+        # The Op arguments, as (name, attribute type, value, tuple size)
+        # entries, array values being tuples. They key the cache of the
+        # built arguments, so only the values the Op uses are read: the
+        # frame, for example, is only passed for moving cubes
+        args = []
+
+        def addArg(name, attrType, value, tupleSize=1):
+            args.append((name, attrType, value, tupleSize))
+
+        def getArrayValue(param, size):
+            return tuple(param.getChildByIndex(i).getValue(frameTime)
+                         for i in range(size))
 
         # Parse node parameters
         locationParam = node.getParameter('location')
         numberOfCubesParam = node.getParameter('numberOfCubes')
         rotateCubesParam = node.getParameter('rotateCubes')
         maxRotationParam = node.getParameter('maxRotation')
+        outputModeParam = node.getParameter('outputMode')
+        proceduralPathParam = node.getParameter('proceduralPath')
+        bucketSizeParam = node.getParameter('bucketSize')
+        xformMatrixParam = node.getParameter('xformMatrix')
+        spatialBucketsParam = node.getParameter('spatialBuckets')
+        useRegionOfInterestParam = node.getParameter('useRegionOfInterest')
+        regionOfInterestParam = node.getParameter('regionOfInterest')
+        placementParam = node.getParameter('placement')
+        seedParam = node.getParameter('seed')
+        scatterSizeParam = node.getParameter('scatterSize')
+        scatterScaleParam = node.getParameter('scatterScale')
+        pointFileParam = node.getParameter('pointFile')
+        subdivisionsParam = node.getParameter('subdivisions')
+        roundnessParam = node.getParameter('roundness')
+        lodDistanceParam = node.getParameter('lodDistance')
+        lodCenterParam = node.getParameter('lodCenter')
+        rotationSpeedParam = node.getParameter('rotationSpeed')
+        translationSpeedParam = node.getParameter('translationSpeed')
+        motionSamplesParam = node.getParameter('motionSamples')
+        shutterOpenParam = node.getParameter('shutterOpen')
+        shutterCloseParam = node.getParameter('shutterClose')
+        displayColorParam = node.getParameter('displayColor')
+        instanceIdParam = node.getParameter('instanceId')
+        memoryReportParam = node.getParameter('memoryReport')
         if locationParam:
-            location = locationParam.getValue(frameTime)
-
-            # The base location is encoded using nested group attributes
-            # defining a hierarchy where the elements in the location paths
-            # are interleaved with group attributes named 'c' (for child).
-            # The last element will contain a group attribute, named 'a',
-            # which in turn will hold an attribute defining the number of
-            # cubes to be generated.
+            # The base location is passed as is, the Op validating it and
+            # creating the locations on its path, alongside a group
+            # attribute, named 'a', which in turn will hold an attribute
+            # defining the number of cubes to be generated.
             # See the Ops source code for more details
-            locationPaths = location[1:].split('/')[1:]
-            attrsHierarchy = \
-                '.'.join([x for t in zip(['c',] * len(locationPaths),
-                                         locationPaths) for x in t])
-            argsGb.set(attrsHierarchy + '.a.numberOfCubes',
-                FnAttribute.IntAttribute(
-                    numberOfCubesParam.getValue(frameTime)))
+            addArg('location', FnAttribute.StringAttribute,
+                   locationParam.getValue(frameTime))
+            addArg('a.numberOfCubes', FnAttribute.IntAttribute,
+                   numberOfCubesParam.getValue(frameTime))
+            # The rotation is only read when enabled
             if rotateCubesParam.getValue(frameTime) == 1:
-                argsGb.set(attrsHierarchy + '.a.maxRotation',
-                    FnAttribute.DoubleAttribute(
-                        maxRotationParam.getValue(frameTime)))
+                addArg('a.maxRotation', FnAttribute.DoubleAttribute,
+                       maxRotationParam.getValue(frameTime))
+            if bucketSizeParam:
+                addArg('a.bucketSize', FnAttribute.IntAttribute,
+                       bucketSizeParam.getValue(frameTime))
+            if spatialBucketsParam:
+                addArg('a.spatialBuckets', FnAttribute.IntAttribute,
+                       spatialBucketsParam.getValue(frameTime))
+            if useRegionOfInterestParam and \
+                    useRegionOfInterestParam.getValue(frameTime) == 1:
+                addArg('a.regionOfInterest', FnAttribute.DoubleAttribute,
+                       getArrayValue(regionOfInterestParam, 6), 2)
+            if xformMatrixParam:
+                addArg('a.xformMatrix', FnAttribute.IntAttribute,
+                       xformMatrixParam.getValue(frameTime))
+            if outputModeParam:
+                outputMode = outputModeParam.getValue(frameTime)
+                addArg('a.outputMode', FnAttribute.StringAttribute,
+                       outputMode)
+                if proceduralPathParam and outputMode == 'procedural':
+                    addArg('a.proceduralPath', FnAttribute.StringAttribute,
+                           proceduralPathParam.getValue(frameTime))
+            if placementParam:
+                placement = placementParam.getValue(frameTime)
+                addArg('a.placement', FnAttribute.StringAttribute,
+                       placement)
+                if placement == 'points':
+                    # The modification time of the point file changes the
+                    # Op args along with it, so that the scene is cooked
+                    # again when the file is replaced (the Op itself maps
+                    # the new file whatever the stamp)
+                    pointFile = pointFileParam.getValue(frameTime)
+                    try:
+                        pointFileStamp = os.path.getmtime(pointFile)
+                    except OSError:
+                        pointFileStamp = 0.0
+                    addArg('a.pointFile', FnAttribute.StringAttribute,
+                           pointFile)
+                    addArg('a.pointFileStamp', FnAttribute.DoubleAttribute,
+                           pointFileStamp)
+                    addArg('a.scatterScale', FnAttribute.DoubleAttribute,
+                           scatterScaleParam.getValue(frameTime))
+                elif placement != 'line':
+                    addArg('a.seed', FnAttribute.IntAttribute,
+                           seedParam.getValue(frameTime))
+                    addArg('a.scatterSize', FnAttribute.DoubleAttribute,
+                           scatterSizeParam.getValue(frameTime))
+                    addArg('a.scatterScale', FnAttribute.DoubleAttribute,
+                           scatterScaleParam.getValue(frameTime))
+            if subdivisionsParam:
+                addArg('a.subdivisions', FnAttribute.IntAttribute,
+                       subdivisionsParam.getValue(frameTime))
+                addArg('a.roundness', FnAttribute.DoubleAttribute,
+                       roundnessParam.getValue(frameTime))
+                addArg('a.lodDistance', FnAttribute.DoubleAttribute,
+                       lodDistanceParam.getValue(frameTime))
+                addArg('a.lodCenter', FnAttribute.DoubleAttribute,
+                       getArrayValue(lodCenterParam, 3), 3)
+            if rotationSpeedParam:
+                rotationSpeed = rotationSpeedParam.getValue(frameTime)
+                translationSpeed = getArrayValue(translationSpeedParam, 3)
+                # Only moving cubes depend on the frame, all the time
+                # samples of their transforms being computed by the Op
+                if rotationSpeed != 0 or any(translationSpeed):
+                    addArg('a.frame', FnAttribute.DoubleAttribute, frameTime)
+                    addArg('a.rotationSpeed', FnAttribute.DoubleAttribute,
+                           rotationSpeed)
+                    addArg('a.translationSpeed', FnAttribute.DoubleAttribute,
+                           translationSpeed, 3)
+                    addArg('a.motionSamples', FnAttribute.IntAttribute,
+                           motionSamplesParam.getValue(frameTime))
+                    addArg('a.shutterOpen', FnAttribute.DoubleAttribute,
+                           shutterOpenParam.getValue(frameTime))
+                    addArg('a.shutterClose', FnAttribute.DoubleAttribute,
+                           shutterCloseParam.getValue(frameTime))
+            if displayColorParam and \
+                    displayColorParam.getValue(frameTime) == 1:
+                addArg('a.displayColor', FnAttribute.IntAttribute, 1)
+            if instanceIdParam and \
+                    instanceIdParam.getValue(frameTime) == 1:
+                addArg('a.instanceId', FnAttribute.IntAttribute, 1)
+            if memoryReportParam and \
+                    memoryReportParam.getValue(frameTime) == 1:
+                addArg('a.memoryReport', FnAttribute.IntAttribute, 1)
+
+        # Reuse the arguments built for the same values, by this node at
+        # another frame or by another node, the Op chain being given the
+        # very same attribute. It is popped and inserted again to make it the
+        # most recently used, OrderedDict.move_to_end() missing from Python 2
+        cacheKey = tuple((name, value) for name, _, value, _ in args)
+        opArgs = opArgsCache.pop(cacheKey, None)
+        if opArgs is None:
+            argsGb = FnAttribute.GroupBuilder()
+            for name, attrType, value, tupleSize in args:
+                if isinstance(value, tuple):
+                    argsGb.set(name, attrType(list(value), tupleSize))
+                else:
+                    argsGb.set(name, attrType(value))
+            opArgs = argsGb.build()
+            if len(opArgsCache) >= maxCachedOpArgs:
+                opArgsCache.popitem(last=False)
+        opArgsCache[cacheKey] = opArgs
 
         # Add the CubeMaker Op to the Ops chain
-        interface.appendOp('CubeMaker', argsGb.build())
+        interface.appendOp('CubeMaker', opArgs)
 
 
     # Create a NodeTypeBuilder to register the new type
@@ -71,6 +211,32 @@ def registerCubeMaker():
     gb.set('numberOfCubes', FnAttribute.IntAttribute(20))
     gb.set('rotateCubes', FnAttribute.IntAttribute(0))
     gb.set('maxRotation', FnAttribute.DoubleAttribute(0))
+    gb.set('outputMode', FnAttribute.StringAttribute('locations'))
+    gb.set('proceduralPath',
+           FnAttribute.StringAttribute('CubeMakerProcedural'))
+    gb.set('bucketSize', FnAttribute.IntAttribute(0))
+    gb.set('spatialBuckets', FnAttribute.IntAttribute(0))
+    gb.set('useRegionOfInterest', FnAttribute.IntAttribute(0))
+    gb.set('regionOfInterest',
+           FnAttribute.DoubleAttribute([-1, 1, -1, 1, -1, 1], 2))
+    gb.set('xformMatrix', FnAttribute.IntAttribute(0))
+    gb.set('placement', FnAttribute.StringAttribute('line'))
+    gb.set('seed', FnAttribute.IntAttribute(0))
+    gb.set('scatterSize', FnAttribute.DoubleAttribute(10))
+    gb.set('scatterScale', FnAttribute.DoubleAttribute(1))
+    gb.set('pointFile', FnAttribute.StringAttribute(''))
+    gb.set('subdivisions', FnAttribute.IntAttribute(0))
+    gb.set('roundness', FnAttribute.DoubleAttribute(0))
+    gb.set('lodDistance', FnAttribute.DoubleAttribute(0))
+    gb.set('lodCenter', FnAttribute.DoubleAttribute([0, 0, 0], 3))
+    gb.set('rotationSpeed', FnAttribute.DoubleAttribute(0))
+    gb.set('translationSpeed', FnAttribute.DoubleAttribute([0, 0, 0], 3))
+    gb.set('motionSamples', FnAttribute.IntAttribute(1))
+    gb.set('shutterOpen', FnAttribute.DoubleAttribute(0))
+    gb.set('shutterClose', FnAttribute.DoubleAttribute(0.5))
+    gb.set('displayColor', FnAttribute.IntAttribute(0))
+    gb.set('instanceId', FnAttribute.IntAttribute(0))
+    gb.set('memoryReport', FnAttribute.IntAttribute(0))
 
     # Set the parameters template
     nodeTypeBuilder.setParametersTemplateAttr(gb.build())
@@ -84,6 +250,129 @@ def registerCubeMaker():
                                          {'conditionalVisOp':'equalTo',
                                           'conditionalVisPath':'../rotateCubes',
                                           'conditionalVisValue':1},)
+    nodeTypeBuilder.setHintsForParameter('outputMode',
+                                         {'widget':'popup',
+                                          'options':['locations',
+                                                     'instanceArray',
+                                                     'procedural']})
+    nodeTypeBuilder.setHintsForParameter('proceduralPath',
+                                         {'conditionalVisOp':'equalTo',
+                                          'conditionalVisPath':'../outputMode',
+                                          'conditionalVisValue':'procedural',
+                                          'help':'Renderer procedural '
+                                                 'expanding the cubes at '
+                                                 'render time.'})
+    nodeTypeBuilder.setHintsForParameter('bucketSize',
+                                         {'int':True,
+                                          'help':'Maximum number of children '
+                                                 'per location, 0 to disable '
+                                                 'bucketing.'})
+    nodeTypeBuilder.setHintsForParameter('spatialBuckets',
+                                         {'widget':'boolean',
+                                          'help':'Group the cubes by position '
+                                                 'instead of by index.'})
+    nodeTypeBuilder.setHintsForParameter('useRegionOfInterest',
+                                         {'widget':'boolean',
+                                          'help':'Only create the cubes '
+                                                 'intersecting the region of '
+                                                 'interest.'})
+    nodeTypeBuilder.setHintsForParameter('regionOfInterest',
+                                         {'help':'Bounding box, as xmin, '
+                                                 'xmax, ymin, ymax, zmin, '
+                                                 'zmax.',
+                                          'conditionalVisOp':'equalTo',
+                                          'conditionalVisPath':
+                                              '../useRegionOfInterest',
+                                          'conditionalVisValue':1})
+    nodeTypeBuilder.setHintsForParameter('xformMatrix', {'widget':'boolean'})
+    nodeTypeBuilder.setHintsForParameter('placement',
+                                         {'widget':'popup',
+                                          'options':['line', 'box', 'sphere',
+                                                     'points']})
+    # The seed and scatter size only apply to the scatter modes
+    scatterVisHints = {'conditionalVisOp':'and',
+                       'conditionalVisLeft':'conditionalVis1',
+                       'conditionalVisRight':'conditionalVis2',
+                       'conditionalVis1Op':'notEqualTo',
+                       'conditionalVis1Path':'../placement',
+                       'conditionalVis1Value':'line',
+                       'conditionalVis2Op':'notEqualTo',
+                       'conditionalVis2Path':'../placement',
+                       'conditionalVis2Value':'points'}
+    nodeTypeBuilder.setHintsForParameter('seed',
+                                         dict(scatterVisHints, int=True))
+    nodeTypeBuilder.setHintsForParameter('scatterSize', scatterVisHints)
+    nodeTypeBuilder.setHintsForParameter('scatterScale',
+                                         {'conditionalVisOp':'notEqualTo',
+                                          'conditionalVisPath':'../placement',
+                                          'conditionalVisValue':'line'})
+    nodeTypeBuilder.setHintsForParameter('pointFile',
+                                         {'widget':'fileInput',
+                                          'help':'Point file giving the '
+                                                 'position and scale of each '
+                                                 'cube.',
+                                          'conditionalVisOp':'equalTo',
+                                          'conditionalVisPath':'../placement',
+                                          'conditionalVisValue':'points'})
+
+    nodeTypeBuilder.setHintsForParameter('subdivisions',
+                                         {'int':True,
+                                          'min':0, 'max':6,
+                                          'help':'Number of times each cube '
+                                                 'face is split in four, for '
+                                                 'the closest cubes.'})
+    nodeTypeBuilder.setHintsForParameter('roundness',
+                                         {'min':0, 'max':1,
+                                          'help':'Rounding of the cube edges '
+                                                 'and corners, from sharp (0) '
+                                                 'to a sphere (1).'})
+    nodeTypeBuilder.setHintsForParameter('lodDistance',
+                                         {'help':'Distance from the LOD center '
+                                                 'over which cubes lose one '
+                                                 'subdivision, 0 to disable.'})
+    nodeTypeBuilder.setHintsForParameter('lodCenter',
+                                         {'conditionalVisOp':'greaterThan',
+                                          'conditionalVisPath':'../lodDistance',
+                                          'conditionalVisValue':0})
+
+    nodeTypeBuilder.setHintsForParameter('rotationSpeed',
+                                         {'help':'Rotation of the cubes, in '
+                                                 'degrees per frame.'})
+    nodeTypeBuilder.setHintsForParameter('translationSpeed',
+                                         {'help':'Translation of the cubes, '
+                                                 'per frame.'})
+    nodeTypeBuilder.setHintsForParameter('motionSamples',
+                                         {'int':True,
+                                          'min':1, 'max':16,
+                                          'help':'Number of time samples of '
+                                                 'the transforms of moving '
+                                                 'cubes, for motion blur.'})
+    nodeTypeBuilder.setHintsForParameter('shutterOpen',
+                                         {'conditionalVisOp':'greaterThan',
+                                          'conditionalVisPath':
+                                              '../motionSamples',
+                                          'conditionalVisValue':1})
+    nodeTypeBuilder.setHintsForParameter('shutterClose',
+                                         {'conditionalVisOp':'greaterThan',
+                                          'conditionalVisPath':
+                                              '../motionSamples',
+                                          'conditionalVisValue':1})
+
+    nodeTypeBuilder.setHintsForParameter('displayColor',
+                                         {'widget':'boolean',
+                                          'help':'Give each cube a random '
+                                                 'displayColor primvar.'})
+    nodeTypeBuilder.setHintsForParameter('instanceId',
+                                         {'widget':'boolean',
+                                          'help':'Give each cube its index '
+                                                 'as an instanceId primvar.'})
+    nodeTypeBuilder.setHintsForParameter('memoryReport',
+                                         {'widget':'boolean',
+                                          'help':'Debug: estimate the memory '
+                                                 'held by the generated '
+                                                 'locations, set as the '
+                                                 'memoryReport attribute of '
+                                                 'the base location.'})
 
     # Set the callback responsible to build the Ops chain
     nodeTypeBuilder.setBuildOpChainFnc(buildCubeMakerOpChain)
@@ -93,3 +382,131 @@ def registerCubeMaker():
 
 # Register the node
 registerCubeMaker()
+
+
+def registerCubeMakerBatch():
+    """
+    Registers a new CubeMakerBatch node type, generating several independent
+    sets of cubes with a single CubeMaker Op, so that the length of the Ops
+    chain doesn't grow with the number of sets.
+    """
+
+    from Katana import Nodes3DAPI
+    from Katana import FnAttribute
+
+    def buildCubeMakerBatchOpChain(node, interface):
+        """
+        Defines the callback function used to create the Ops chain for the
+        node type being registered.
+
+        @type node: C{Nodes3DAPI.NodeTypeBuilder.CubeMakerBatch}
+        @type interface: C{Nodes3DAPI.NodeTypeBuilder.BuildChainInterface}
+        @param node: The node for which to define the Ops chain
+        @param interface: The interface providing the functions needed to set
+            up the Ops chain for the given node.
+        """
+        # Get the current frame time
+        frameTime = interface.getGraphState().getTime()
+
+        # Set the minimum number of input ports
+        interface.setMinRequiredInputs(0)
+
+        def getArrayValues(param):
+            return [param.getChildByIndex(i).getValue(frameTime)
+                    for i in range(param.getNumChildren())]
+
+        # Parse node parameters, the arrays holding one value per set
+        locations = getArrayValues(node.getParameter('locations'))
+        numberOfCubes = getArrayValues(node.getParameter('numberOfCubes'))
+        maxRotations = getArrayValues(node.getParameter('maxRotation'))
+        seeds = getArrayValues(node.getParameter('seed'))
+        outputMode = node.getParameter('outputMode').getValue(frameTime)
+        bucketSize = node.getParameter('bucketSize').getValue(frameTime)
+        placement = node.getParameter('placement').getValue(frameTime)
+
+        # Each set is given its base location and an 'a' group, as for the
+        # CubeMaker node, under the 'sets' group. Sets missing a value use
+        # the default one.
+        # See the Ops source code for more details
+        argsGb = FnAttribute.GroupBuilder()
+        for i, location in enumerate(locations):
+            setPrefix = 'sets.set%d.' % i
+            argsGb.set(setPrefix + 'location',
+                FnAttribute.StringAttribute(location))
+            argsGb.set(setPrefix + 'a.numberOfCubes',
+                FnAttribute.IntAttribute(
+                    numberOfCubes[i] if i < len(numberOfCubes) else 20))
+            if i < len(maxRotations):
+                argsGb.set(setPrefix + 'a.maxRotation',
+                    FnAttribute.DoubleAttribute(maxRotations[i]))
+            argsGb.set(setPrefix + 'a.outputMode',
+                FnAttribute.StringAttribute(outputMode))
+            argsGb.set(setPrefix + 'a.bucketSize',
+                FnAttribute.IntAttribute(bucketSize))
+            argsGb.set(setPrefix + 'a.placement',
+                FnAttribute.StringAttribute(placement))
+            if placement != 'line':
+                argsGb.set(setPrefix + 'a.seed',
+                    FnAttribute.IntAttribute(
+                        seeds[i] if i < len(seeds) else i))
+
+        # Add the CubeMaker Op to the Ops chain
+        interface.appendOp('CubeMaker', argsGb.build())
+
+
+    # Create a NodeTypeBuilder to register the new type
+    nodeTypeBuilder = Nodes3DAPI.NodeTypeBuilder('CubeMakerBatch')
+
+    # Build the node's parameters
+    gb = FnAttribute.GroupBuilder()
+    gb.set('locations',
+           FnAttribute.StringAttribute(['/root/world/geo/cubeMaker'], 1))
+    gb.set('numberOfCubes', FnAttribute.IntAttribute([20], 1))
+    gb.set('maxRotation', FnAttribute.DoubleAttribute([0], 1))
+    gb.set('seed', FnAttribute.IntAttribute([0], 1))
+    gb.set('outputMode', FnAttribute.StringAttribute('locations'))
+    gb.set('bucketSize', FnAttribute.IntAttribute(0))
+    gb.set('placement', FnAttribute.StringAttribute('line'))
+
+    # Set the parameters template
+    nodeTypeBuilder.setParametersTemplateAttr(gb.build())
+
+    # Set parameter hints
+    nodeTypeBuilder.setHintsForParameter('locations',
+                                         {'isDynamicArray':True,
+                                          'widget':'scenegraphLocationArray',
+                                          'help':'Base location of each set '
+                                                 'of cubes.'})
+    nodeTypeBuilder.setHintsForParameter('numberOfCubes',
+                                         {'isDynamicArray':True,
+                                          'int':True})
+    nodeTypeBuilder.setHintsForParameter('maxRotation',
+                                         {'isDynamicArray':True})
+    nodeTypeBuilder.setHintsForParameter('seed',
+                                         {'isDynamicArray':True,
+                                          'int':True,
+                                          'conditionalVisOp':'notEqualTo',
+                                          'conditionalVisPath':'../placement',
+                                          'conditionalVisValue':'line'})
+    nodeTypeBuilder.setHintsForParameter('outputMode',
+                                         {'widget':'popup',
+                                          'options':['locations',
+                                                     'instanceArray',
+                                                     'procedural']})
+    nodeTypeBuilder.setHintsForParameter('bucketSize',
+                                         {'int':True,
+                                          'help':'Maximum number of children '
+                                                 'per location, 0 to disable '
+                                                 'bucketing.'})
+    nodeTypeBuilder.setHintsForParameter('placement',
+                                         {'widget':'popup',
+                                          'options':['line', 'box', 'sphere']})
+
+    # Set the callback responsible to build the Ops chain
+    nodeTypeBuilder.setBuildOpChainFnc(buildCubeMakerBatchOpChain)
+
+    # Build the new node type
+    nodeTypeBuilder.build()
+
+# Register the node
+registerCubeMakerBatch()
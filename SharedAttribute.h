@@ -0,0 +1,53 @@
+#ifndef KATANAOPS_SHAREDATTRIBUTE_H
+#define KATANAOPS_SHAREDATTRIBUTE_H
+
+#include <FnAttribute/FnAttribute.h>
+
+namespace KatanaOps
+{
+
+/**
+ * SharedAttribute
+ *
+ * Immutable attribute set, as is, on many locations.
+ *
+ * Geolib and the renderer plug-ins hash the attributes of each location to
+ * look up their caches and dedupe identical data: handing out a single
+ * long-lived attribute, instead of equal copies, makes the hash of its
+ * payload, which the attribute caches, computed once, and every later
+ * comparison a match on the same handle. Meant to be held by function-local
+ * statics, or caches handing out copies, as getCachedMesh() does.
+ */
+template <typename AttributeType>
+class SharedAttribute
+{
+public:
+
+    explicit SharedAttribute(const AttributeType &attr)
+        : m_attr(attr)
+    {
+    }
+
+    const AttributeType& get() const { return m_attr; }
+
+    /**
+     * Returns whether the given attribute is this one, rather than a copy of
+     * its value
+     */
+    bool isSameAttr(const FnAttribute::Attribute &attr) const
+    {
+        return attr.getHandle() == m_attr.getHandle();
+    }
+
+private:
+
+    AttributeType m_attr;
+};
+
+typedef SharedAttribute<FnAttribute::DoubleAttribute> SharedDoubleAttribute;
+typedef SharedAttribute<FnAttribute::GroupAttribute> SharedGroupAttribute;
+typedef SharedAttribute<FnAttribute::StringAttribute> SharedStringAttribute;
+
+} // namespace KatanaOps
+
+#endif // KATANAOPS_SHAREDATTRIBUTE_H